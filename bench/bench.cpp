@@ -0,0 +1,342 @@
+// ---------------------------------------------------------------------------
+// bench.cpp
+// Microbenchmarks for building and querying the QuadTree and for sensing.
+//
+// Every configuration is timed several times and summarised as JSON on
+// stdout, so runs can be compared by a script. Progress goes to stderr.
+//
+//     bench [-n repetitions] [-q] [-t threads]
+//
+// -q runs a smaller sweep that finishes in a few seconds. -t sets the
+// threads of QuadTree::build(), one per processor by default.
+//
+// This file is available on Github: https://github.com/antsam/universe
+// ---------------------------------------------------------------------------
+#include "src/QuadTree.h"
+#include "src/kernels.h"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+
+// one summary per configuration
+struct result
+{
+    const char *name;
+    std::size_t population, max_leaves, pixel_count;
+    double fov; // degrees
+    std::vector<double> samples; // nanoseconds per item, one per repetition
+};
+
+static double now_ns()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec * 1e9) + t.tv_nsec;
+}
+
+// nearest-rank percentile of sorted samples
+static double percentile(const std::vector<double> &sorted, const double &p)
+{
+    std::size_t rank = (std::size_t)ceil((p / 100.0) * sorted.size());
+    return sorted[(rank > 0) ? (rank - 1) : 0];
+}
+
+static void print_result(const result &r, bool last)
+{
+    std::vector<double> sorted(r.samples);
+    std::sort(sorted.begin(), sorted.end());
+
+    double mean = 0, variance = 0;
+    FOR_EACH(it, sorted)
+    {
+        mean += *it;
+    }
+    mean /= sorted.size();
+    FOR_EACH(it, sorted)
+    {
+        variance += (*it - mean) * (*it - mean);
+    }
+    variance /= (sorted.size() > 1) ? (sorted.size() - 1) : 1;
+
+    printf("    {\"name\": \"%s\", \"population\": %lu, \"max_leaves\": %lu, \"fov\": %g, \"pixel_count\": %lu, ",
+           r.name, (long unsigned)r.population, (long unsigned)r.max_leaves, r.fov, (long unsigned)r.pixel_count);
+    printf("\"unit\": \"ns\", \"repetitions\": %lu, \"mean\": %.3f, \"stddev\": %.3f, ",
+           (long unsigned)sorted.size(), mean, sqrt(variance));
+    printf("\"min\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}%s\n",
+           sorted.front(), percentile(sorted, 50), percentile(sorted, 90), percentile(sorted, 99), sorted.back(),
+           last ? "" : ",");
+}
+
+static void scatter(std::vector<Uni::Robot> &population)
+{
+    FOR_EACH(it, population)
+    {
+        Uni::RandomPose(it->pose);
+    }
+}
+
+// points to query: anywhere, or within range of an edge of the world so
+// the query wraps around the torus
+static void query_points(std::vector<Anton::coord> &points, bool edges)
+{
+    const double range = Uni::Robot::range;
+    std::size_t i = 0;
+
+    for(; i < points.size(); ++i)
+    {
+        points[i].x = drand48();
+        points[i].y = drand48();
+
+        if(edges)
+        {
+            double across = range * drand48();
+
+            switch(i % 3)
+            {
+                case 0: points[i].x = (i & 4) ? across : (1.0 - across); break;
+                case 1: points[i].y = (i & 4) ? across : (1.0 - across); break;
+                default: // a corner
+                    points[i].x = (i & 4) ? across : (1.0 - across);
+                    points[i].y = (i & 8) ? (range * drand48()) : (1.0 - (range * drand48()));
+            }
+        }
+    }
+}
+
+// ns per robot to fill a flushed tree
+static void bench_build(result &r, const std::size_t &repetitions)
+{
+    Anton::box canvas(0.5, 0.5, 1.0, 1.0);
+    Anton::QuadTree tree(canvas, r.max_leaves);
+    std::vector<Uni::Robot> population(r.population);
+    std::size_t rep = 0;
+    double start;
+
+    scatter(population);
+
+    for(; rep <= repetitions; ++rep)
+    {
+        tree.flush();
+        start = now_ns();
+        FOR_EACH(it, population)
+        {
+            tree.add_leaf(&(*it));
+        }
+
+        if(rep > 0) // the first run grows the node pool
+        {
+            r.samples.push_back((now_ns() - start) / r.population);
+        }
+    }
+}
+
+// ns per robot for QuadTree::build() on the threads of pool, which fills
+// the same tree as bench_build()
+static void bench_parallel_build(result &r, const std::size_t &repetitions, Anton::ThreadPool &pool)
+{
+    Anton::box canvas(0.5, 0.5, 1.0, 1.0);
+    Anton::QuadTree tree(canvas, r.max_leaves);
+    std::vector<Uni::Robot> population(r.population);
+    std::vector<Uni::real> xs(r.population), ys(r.population);
+    std::vector<uint32_t> ids(r.population);
+    std::size_t rep = 0, i;
+    double start;
+
+    scatter(population);
+    for(i = 0; i < r.population; ++i)
+    {
+        xs[i] = population[i].pose[0];
+        ys[i] = population[i].pose[1];
+        ids[i] = i;
+    }
+
+    for(; rep <= repetitions; ++rep)
+    {
+        start = now_ns();
+        tree.build(&xs[0], &ys[0], &population[0], &ids[0], r.population, pool);
+
+        if(rep > 0) // the first run grows the node pool
+        {
+            r.samples.push_back((now_ns() - start) / r.population);
+        }
+    }
+}
+
+// ns per find_in_range() query
+static void bench_query(result &r, const std::size_t &repetitions, bool edges)
+{
+    Anton::box canvas(0.5, 0.5, 1.0, 1.0);
+    Anton::QuadTree tree(canvas, r.max_leaves);
+    std::vector<Uni::Robot> population(r.population);
+    std::vector<Anton::coord> points(1000);
+    std::vector<Uni::Robot *> found;
+    const double side = 2 * Uni::Robot::range;
+    std::size_t rep = 0, hits = 0;
+    double start;
+
+    scatter(population);
+    FOR_EACH(it, population)
+    {
+        tree.add_leaf(&(*it));
+    }
+
+    for(; rep < repetitions; ++rep)
+    {
+        query_points(points, edges);
+
+        start = now_ns();
+        FOR_EACH(p, points)
+        {
+            found.clear();
+            tree.find_in_range(Anton::box(p->x, p->y, side, side), found);
+            hits += found.size();
+        }
+        r.samples.push_back((now_ns() - start) / points.size());
+    }
+
+    if(hits == 0)
+    {
+        fprintf(stderr, "[bench] no robots found by %s\n", r.name);
+    }
+}
+
+// ns per Robot::UpdateSensor() call
+static void bench_sense(result &r, const std::size_t &repetitions)
+{
+    Uni::Robot::pixel_count = r.pixel_count;
+    Uni::Robot::fov = Uni::dtor(r.fov);
+
+    // new robots pick up the pixel count
+    Uni::population.assign(r.population, Uni::Robot());
+    scatter(Uni::population);
+    Uni::BuildIndex();
+
+    const std::size_t sample = std::min(r.population, (std::size_t)1000);
+    std::size_t rep = 0, i;
+    double start;
+
+    for(; rep < repetitions; ++rep)
+    {
+        std::size_t first = (std::size_t)(drand48() * (r.population - sample));
+
+        start = now_ns();
+        for(i = first; i < (first + sample); ++i)
+        {
+            Uni::population[i].UpdateSensor();
+        }
+        r.samples.push_back((now_ns() - start) / sample);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::size_t repetitions = 10;
+    bool quick = false;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int c;
+
+    while((c = getopt(argc, argv, "n:qt:")) != -1)
+    {
+        switch(c)
+        {
+            case 'n':
+                repetitions = atoi(optarg);
+                if(repetitions < 1) repetitions = 1;
+                break;
+            case 'q':
+                quick = true;
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n repetitions] [-q] [-t threads]\n", argv[0]);
+                return -1;
+        }
+    }
+
+    const std::size_t populations[] = { 1000, 10000, 100000 };
+    const std::size_t leaf_counts[] = { 10, 20, 40, 80 };
+    const double fovs[] = { 90, 180, 270, 360 };
+    const std::size_t pixel_counts[] = { 8, 32, 128 };
+
+    std::size_t population_count = quick ? 2 : 3;
+    std::size_t leaf_count = quick ? 2 : 4;
+    std::size_t fov_count = quick ? 2 : 4;
+    std::size_t pixel_count = quick ? 2 : 3;
+
+    std::vector<result> results;
+    result r;
+    std::size_t p, l, f, x;
+
+    srand48(0);
+    Uni::SelectFilterKernel(NULL);
+    Anton::ThreadPool pool((threads > 0) ? threads : 1);
+
+    for(p = 0; p < population_count; ++p)
+    {
+        for(l = 0; l < leaf_count; ++l)
+        {
+            r.population = populations[p];
+            r.max_leaves = leaf_counts[l];
+            r.fov = 0;
+            r.pixel_count = 0;
+
+            const char *names[] = { "quadtree_build", "quadtree_build_parallel", "find_in_range", "find_in_range_edge" };
+            for(x = 0; x < 4; ++x)
+            {
+                r.name = names[x];
+                r.samples.clear();
+                fprintf(stderr, "[bench] %s population %lu max_leaves %lu\n",
+                        r.name, (long unsigned)r.population, (long unsigned)r.max_leaves);
+
+                if(x == 0)
+                    bench_build(r, repetitions);
+                else if(x == 1)
+                    bench_parallel_build(r, repetitions, pool);
+                else
+                    bench_query(r, repetitions, x == 3);
+
+                results.push_back(r);
+            }
+        }
+    }
+
+    // sensing goes through the simulation's own index, which has 10 leaves
+    // per node. The populations are smaller since every robot sees more.
+    const std::size_t sense_populations[] = { 1000, 4000, 16000 };
+    Uni::population.resize(1);
+    Uni::Start();
+
+    for(p = 0; p < population_count; ++p)
+    {
+        for(f = 0; f < fov_count; ++f)
+        {
+            for(x = 0; x < pixel_count; ++x)
+            {
+                r.name = "update_sensor";
+                r.population = sense_populations[p];
+                r.max_leaves = 10;
+                r.fov = fovs[f];
+                r.pixel_count = pixel_counts[x];
+                r.samples.clear();
+                fprintf(stderr, "[bench] %s population %lu fov %g pixel_count %lu\n",
+                        r.name, (long unsigned)r.population, r.fov, (long unsigned)r.pixel_count);
+
+                bench_sense(r, repetitions);
+                results.push_back(r);
+            }
+        }
+    }
+
+    printf("{\n  \"filter_kernel\": \"%s\",\n  \"range\": %g,\n  \"build_threads\": %lu,\n  \"benchmarks\": [\n",
+           Uni::FilterKernelName(), Uni::Robot::range, (long unsigned)pool.get_thread_count());
+    for(x = 0; x < results.size(); ++x)
+    {
+        print_result(results[x], (x + 1) == results.size());
+    }
+    printf("  ]\n}\n");
+
+    return 0;
+}
@@ -15,6 +15,41 @@
 using namespace Anton;
 
 const std::size_t DEFAULT_MAX_LEAVES = 10;
+const std::size_t BUILD_SPLIT_MIN = 2048; // build() hands smaller subtrees to one thread
+const std::size_t BUILD_TASKS_PER_THREAD = 8; // subtrees build() aims for, to even out the threads
+
+// the robots build() copies into the tree
+struct build_source
+{
+    const Uni::real *x, *y;
+    Uni::Robot *robots;
+    const uint32_t *ids;
+    std::vector<leaf> *items;
+    box world;
+};
+
+// copy robots [begin, end) into build_items. Robots outside the world are
+// left out, as add_leaf() would, by having no robot.
+static void gather_leaves(std::size_t begin, std::size_t end, std::size_t worker, void *data)
+{
+    const build_source &source = *static_cast<build_source *>(data);
+    leaf *items = &(*source.items)[0];
+
+    for(; begin < end; ++begin)
+    {
+        const Uni::real &x = source.x[begin], &y = source.y[begin];
+        bool inside = source.world.in_range(x, source.world.min_x(), source.world.max_x())
+            && source.world.in_range(y, source.world.min_y(), source.world.max_y());
+
+        items[begin] = leaf(x, y, inside ? &source.robots[source.ids[begin]] : NULL);
+    }
+}
+
+// bigger subtrees first, so the last ones to be claimed are small
+static bool larger_task(const std::pair<std::size_t, std::size_t> &a, const std::pair<std::size_t, std::size_t> &b)
+{
+    return a.first > b.first;
+}
 
 QuadTree::QuadTree(const box &bounds, const std::size_t &max_leaves)
 {
@@ -25,114 +60,204 @@ QuadTree::QuadTree(const box &bounds, const std::size_t &max_leaves)
 
     this->max_leaves = ((max_leaves > 0) && (max_leaves > DEFAULT_MAX_LEAVES)) ? max_leaves : DEFAULT_MAX_LEAVES;
 
-    this->northwest = NULL;
-    this->northeast = NULL;
-    this->southwest = NULL;
-    this->southeast = NULL;
+    this->reset();
 }
 
-// delete the trees on destruction
+// the pool owns all of the nodes and leaves
 QuadTree::~QuadTree()
 {
-    if(!this->leaves.empty())
-    {
-        this->leaves.clear();
-    }
-
-    this->clear();
 }
 
 bool QuadTree::add_leaf(Uni::Robot *r)
 {
-    if(!this->bounds.contains_coord(r->pose[0], r->pose[1]))
+    return this->add_leaf(r, r->pose[0], r->pose[1]);
+}
+
+// add a robot at a position that may be newer than its pose
+bool QuadTree::add_leaf(Uni::Robot *r, const Uni::real &x, const Uni::real &y)
+{
+    location where;
+
+    return this->place(leaf(x, y, r), where);
+}
+
+void QuadTree::build(const Uni::real *x, const Uni::real *y, Uni::Robot *robots, const uint32_t *ids,
+                     const std::size_t &count, ThreadPool &pool)
+{
+    this->flush();
+    if(count == 0)
     {
-        return false;
+        return;
     }
 
-    if(this->leaves.size() < this->max_leaves)
+    // on one thread, splitting the robots up first only adds work
+    if(pool.get_thread_count() == 1)
     {
-        this->leaves.push_back(r);
-        return true;
+        std::size_t i = 0;
+        for(; i < count; ++i)
+        {
+            this->add_leaf(&robots[ids[i]], x[i], y[i]);
+        }
+        return;
     }
 
-    if(this->northwest == NULL)
+    // every node with children is full, so this many nodes is always enough
+    // and the threads never have to grow the pool
+    const std::size_t most_nodes = 1 + (4 * (count / this->max_leaves));
+    if(this->nodes.size() < most_nodes)
     {
-        this->subdivide();
+        this->nodes.resize(most_nodes);
+        this->leaves.resize(this->nodes.size() * this->max_leaves);
     }
 
-    if(this->northwest->add_leaf(r))
+    build_source source = { x, y, robots, ids, &this->build_items, this->nodes[0].bounds };
+    this->build_items.resize(count);
+    this->build_scratch.resize(count);
+    pool.parallel_for(count, 4096, gather_leaves, &source);
+
+    // split off subtrees a level at a time until there are enough of them
+    build_task whole = { 0, 0, count, false };
+    const std::size_t wanted = (pool.get_thread_count() > 1) ? (BUILD_TASKS_PER_THREAD * pool.get_thread_count()) : 1;
+    bool split = true;
+
+    this->build_tasks.assign(1, whole);
+    while(split && (this->build_tasks.size() < wanted))
     {
-        return true;
+        split = false;
+        this->build_next.clear();
+        FOR_EACH(task, this->build_tasks)
+        {
+            if((task->end - task->begin) >= BUILD_SPLIT_MIN)
+            {
+                this->fill(*task, this->build_next);
+                split = true;
+            }
+            else
+            {
+                this->build_next.push_back(*task);
+            }
+        }
+        this->build_tasks.swap(this->build_next);
     }
 
-    if(this->northeast->add_leaf(r))
+    std::vector<std::pair<std::size_t, std::size_t> > order(this->build_tasks.size());
+    std::size_t i = 0;
+    for(; i < order.size(); ++i)
     {
-        return true;
+        order[i] = std::make_pair(this->build_tasks[i].end - this->build_tasks[i].begin, i);
     }
+    std::sort(order.begin(), order.end(), larger_task);
 
-    if(this->southwest->add_leaf(r))
+    this->build_next.resize(order.size());
+    for(i = 0; i < order.size(); ++i)
     {
-        return true;
+        this->build_next[i] = this->build_tasks[order[i].second];
+    }
+    this->build_tasks.swap(this->build_next);
+
+    pool.parallel_for(this->build_tasks.size(), 1, build_job, this);
+}
+
+bool QuadTree::insert_leaf(const uint32_t &handle, Uni::Robot *r, const Uni::real &x, const Uni::real &y)
+{
+    if(this->locations.size() <= handle)
+    {
+        location nowhere = { 0, this->max_leaves, NULL };
+        this->locations.resize(handle + 1, nowhere);
+    }
+
+    this->locations[handle].robot = r;
+    return this->place(leaf(x, y, r, handle), this->locations[handle]);
+}
+
+// update the position of a robot, moving it only if it has left its node.
+// A robot that is not in the tree, because it was removed or was outside
+// the world, is put back if it is inside now.
+bool QuadTree::move_leaf(const uint32_t &handle, const Uni::real &x, const Uni::real &y)
+{
+    if((handle >= this->locations.size()) || (this->locations[handle].robot == NULL))
+    {
+        return false; // never inserted
+    }
+
+    location &where = this->locations[handle];
+
+    if(where.slot == this->max_leaves)
+    {
+        return this->place(leaf(x, y, where.robot, handle), where);
     }
 
-    if(this->southeast->add_leaf(r))
+    leaf &l = this->leaves[(where.node * this->max_leaves) + where.slot];
+
+    if(this->nodes[where.node].bounds.contains_coord(x, y))
     {
+        l.x = x;
+        l.y = y;
         return true;
     }
 
-    // if we got here, something really bad happened
+    this->remove_leaf(handle);
+    ++this->moved_count;
 
-    return false;
+    return this->place(leaf(x, y, where.robot, handle), where);
 }
 
-std::vector<Uni::Robot *> QuadTree::get_leaves_at(const box &b)
+void QuadTree::remove_leaf(const uint32_t &handle)
 {
-    std::vector<Uni::Robot *> found;
-
-    if(!this->bounds.intersects(b))
+    if((handle >= this->locations.size()) || (this->locations[handle].slot == this->max_leaves))
     {
-        return found;   // not in this quadrant
+        return; // not in the tree
     }
 
-    std::size_t i = 0, local_leaves = this->leaves.size();
-    for(; i < local_leaves; ++i)
+    location &where = this->locations[handle];
+    std::size_t n = where.node;
+    node &current = this->nodes[n];
+    leaf *local = &this->leaves[n * this->max_leaves];
+
+    // fill the gap with the last leaf of the node
+    --current.count;
+    if(where.slot != current.count)
     {
-        if(b.contains_coord(this->leaves[i]->pose[0], this->leaves[i]->pose[1]))
+        local[where.slot] = local[current.count];
+        if(local[where.slot].handle != NO_HANDLE)
         {
-            found.push_back(this->leaves[i]);
+            this->locations[local[where.slot].handle].slot = where.slot;
         }
     }
 
-    if(this->northwest == NULL)
-    {
-        return found;
-    }
+    where.slot = this->max_leaves; // not in the tree
+
+    this->merge(n);
+}
 
-    std::vector<Uni::Robot *> nw = this->northwest->get_leaves_at(b);
-    std::vector<Uni::Robot *> ne = this->northeast->get_leaves_at(b);
-    std::vector<Uni::Robot *> sw = this->southwest->get_leaves_at(b);
-    std::vector<Uni::Robot *> se = this->southeast->get_leaves_at(b);
+std::vector<Uni::Robot *> QuadTree::get_leaves_at(const box &b)
+{
+    std::vector<Uni::Robot *> found;
 
-    found.insert(found.end(), nw.begin(), nw.end());
-    found.insert(found.end(), ne.begin(), ne.end());
-    found.insert(found.end(), sw.begin(), sw.end());
-    found.insert(found.end(), se.begin(), se.end());
+    this->get_leaves_at(b, found);
 
     return found;
 }
 
+void QuadTree::get_leaves_at(const box &b, std::vector<Uni::Robot *> &found) const
+{
+    robot_collector collect(found);
+
+    this->visit_leaves_at(b, collect);
+}
+
 // polymorphic if you want it.
 std::vector<Uni::Robot *> QuadTree::get_leaves_at(const coord &p)
 {
-    double search_range = 2 * Uni::Robot::range;
+    Uni::real search_range = 2 * Uni::Robot::range;
     box range(p, search_range, search_range);
 
     return this->get_leaves_at(range);
 }
 
-std::vector<Uni::Robot *> QuadTree::get_leaves_at(const double &x, const double &y)
+std::vector<Uni::Robot *> QuadTree::get_leaves_at(const Uni::real &x, const Uni::real &y)
 {
-    double search_range = 2 * Uni::Robot::range;
+    Uni::real search_range = 2 * Uni::Robot::range;
     box range(x, y, search_range, search_range);
 
     return this->get_leaves_at(range);
@@ -140,247 +265,398 @@ std::vector<Uni::Robot *> QuadTree::get_leaves_at(const double &x, const double
 
 std::vector<Uni::Robot *> QuadTree::find_in_range(const coord &p)
 {
-    double search_range = 2 * Uni::Robot::range;
+    Uni::real search_range = 2 * Uni::Robot::range;
     box range(p, search_range, search_range);
 
     return this->find_in_range(range);
 }
 
-std::vector<Uni::Robot *> QuadTree::find_in_range(const double &x, const double &y)
+std::vector<Uni::Robot *> QuadTree::find_in_range(const Uni::real &x, const Uni::real &y)
 {
-    double search_range = 2 * Uni::Robot::range;
+    Uni::real search_range = 2 * Uni::Robot::range;
     box range(x, y, search_range, search_range);
 
     return this->find_in_range(range);
 }
 
-// Find any robots that may be in the torus range
 std::vector<Uni::Robot *> QuadTree::find_in_range(const box &b)
 {
     std::vector<Uni::Robot *> found;
 
-    found = this->get_leaves_at(b);
+    this->find_in_range(b, found);
+
+    return found;
+}
+
+// Find any robots that may be in the torus range
+void QuadTree::find_in_range(const box &b, std::vector<Uni::Robot *> &found) const
+{
+    robot_collector collect(found);
+
+    this->visit_in_range(b, collect);
+}
+
+// drop all of the nodes and give the pooled memory back
+void QuadTree::clear()
+{
+    std::vector<node>().swap(this->nodes);
+    std::vector<leaf>().swap(this->leaves);
+
+    this->reset();
+}
+
+// drop all of the nodes but keep the pool around for the next rebuild
+void QuadTree::flush()
+{
+    this->node_count = 1;
+    this->nodes[0].count = 0;
+    this->nodes[0].children = 0;
+    this->nodes[0].parent = 0;
+    this->free_blocks.clear();
+    this->locations.clear();
+    this->moved_count = 0;
+}
+
+size_t QuadTree::get_max_leaves() const
+{
+    return this->max_leaves;
+}
+
+// number of nodes currently in the tree, including the root
+size_t QuadTree::get_node_count() const
+{
+    return this->node_count - (4 * this->free_blocks.size());
+}
 
-    if((b.min_x() >= 0.0f) && (b.min_y() >= 0.0f) && (b.max_x() <= 1.0f) && (b.max_y() <= 1.0f))
+// number of times move_leaf() had to put a robot in another node
+size_t QuadTree::get_moved_count() const
+{
+    return this->moved_count;
+}
+
+// PRIVATE FUNCTIONS
+
+// Split a query into the boxes that cover it on the torus, whose size is
+// that of the root. The first box is always b itself, and the others are b
+// moved by a whole world in x, y or both to bring in the robots past each
+// edge it crosses. None of the boxes overlap as long as b is no larger than
+// the world; a bigger query covers the whole world on that axis instead.
+// Returns the number of boxes written to queries.
+std::size_t QuadTree::torus_queries(const box &b, box queries[4]) const
+{
+    const Uni::real world_width = this->bounds.width, world_height = this->bounds.height;
+    box query = b;
+    Uni::real shift_x = 0, shift_y = 0;
+
+    if(query.width > world_width)
+    {
+        query.centre.x = this->bounds.centre.x;
+        query.width = 2 * world_width;
+    }
+    else if(query.min_x() < this->bounds.min_x())
+    {
+        shift_x = world_width;
+    }
+    else if(query.max_x() > this->bounds.max_x())
+    {
+        shift_x = -world_width;
+    }
+
+    if(query.height > world_height)
+    {
+        query.centre.y = this->bounds.centre.y;
+        query.height = 2 * world_height;
+    }
+    else if(query.min_y() < this->bounds.min_y())
+    {
+        shift_y = world_height;
+    }
+    else if(query.max_y() > this->bounds.max_y())
     {
-        return found;
+        shift_y = -world_height;
     }
 
-    // deal with robots in torus
-    std::vector<Uni::Robot *> overflow;
-    box query;
+    std::size_t query_count = 0;
+    queries[query_count++] = query;
 
-    if(b.min_x() < 0.0f)
+    if(shift_x != 0)
     {
-        query.width = b.min_x() * (-2);
-        query.height = b.height;
-        query.centre.x = 1;
-        query.centre.y = b.centre.y;
-        overflow = this->get_leaves_at(query);
+        queries[query_count] = query;
+        queries[query_count++].centre.x += shift_x;
+    }
 
-        if(!overflow.empty())
-        {
-            found.insert(found.end(), overflow.begin(), overflow.end());
-            overflow.clear();
-        }
+    if(shift_y != 0)
+    {
+        queries[query_count] = query;
+        queries[query_count++].centre.y += shift_y;
     }
-    else if(b.max_x() > 1.0f)
+
+    if((shift_x != 0) && (shift_y != 0))
     {
-        query.width = (1 - b.min_x()) * 2;
-        query.height = b.height;
-        query.centre.x = 0;
-        query.centre.y = b.centre.y;
-        overflow = this->get_leaves_at(query);
+        queries[query_count] = query;
+        queries[query_count].centre.x += shift_x;
+        queries[query_count++].centre.y += shift_y;
+    }
 
-        if(!overflow.empty())
-        {
-            found.insert(found.end(), overflow.begin(), overflow.end());
-            overflow.clear();
-        }
+    return query_count;
+}
+
+// put a leaf in the first node on its path that has room, splitting full
+// nodes on the way
+bool QuadTree::place(const leaf &l, location &where)
+{
+    // the edges of the world are part of it
+    const box &world = this->nodes[0].bounds;
+    if(!world.in_range(l.x, world.min_x(), world.max_x()) || !world.in_range(l.y, world.min_y(), world.max_y()))
+    {
+        return false;
     }
 
-    if(b.min_y() < 0.0f)
+    std::size_t n = 0;
+
+    while(true)
     {
-        query.width = b.width;
-        query.height = b.min_y() * (-2);
-        query.centre.x = b.centre.x;
-        query.centre.y = 1;
-        overflow = this->get_leaves_at(query);
+        node &current = this->nodes[n];
 
-        if(!overflow.empty())
+        if(current.count < this->max_leaves)
         {
-            found.insert(found.end(), overflow.begin(), overflow.end());
-            overflow.clear();
+            where.node = n;
+            where.slot = current.count;
+            this->leaves[(n * this->max_leaves) + current.count] = l;
+            ++current.count;
+            return true;
         }
-    }
-    else if(b.max_y() > 1.0f)
-    {
-        query.width = b.width;
-        query.height = (1 - b.min_y()) * 2;
-        query.centre.x = b.centre.x;
-        query.centre.y = 0;
-        overflow = this->get_leaves_at(query);
 
-        if(!overflow.empty())
+        if(current.children == 0)
         {
-            found.insert(found.end(), overflow.begin(), overflow.end());
-            overflow.clear();
+            this->subdivide(n); // may grow the pool, so current is not used past here
         }
+
+        // the children are nw, ne, sw, se. A leaf on the line between two
+        // goes east or south.
+        const coord &centre = this->nodes[n].bounds.centre;
+        n = this->nodes[n].children + ((l.x < centre.x) ? 0 : 1) + ((l.y > centre.y) ? 0 : 2);
     }
+}
 
-    if((b.min_x() < 0.0f) && (b.min_y() < 0.0f))
-    {
-        query.width = b.min_x() * (-2);
-        query.height = b.min_y() * (-2);
-        query.centre.x = 1;
-        query.centre.y = 1;
-        overflow = this->get_leaves_at(query);
+// Fill node n the way add_leaf() would: the first max_leaves items that
+// reach it stay, and the rest are split between its children in order.
+// Appends a task for every child that got any.
+void QuadTree::fill(const build_task &task, std::vector<build_task> &children)
+{
+    const leaf *from = task.in_scratch ? &this->build_scratch[0] : &this->build_items[0];
+    leaf *to = task.in_scratch ? &this->build_items[0] : &this->build_scratch[0];
+    leaf *local = &this->leaves[task.node * this->max_leaves];
+    const coord centre = this->nodes[task.node].bounds.centre;
+    std::size_t i = task.begin, placed = 0, rest = 0, quadrant, counts[4] = { 0, 0, 0, 0 };
 
-        if(!overflow.empty())
+    for(; (i < task.end) && (placed < this->max_leaves); ++i)
+    {
+        if(from[i].robot != NULL)
         {
-            found.insert(found.end(), overflow.begin(), overflow.end());
-            overflow.clear();
+            local[placed++] = from[i];
         }
     }
-    else if((b.max_x() > 1.0f) && (b.max_y() > 1.0f))
-    {
-        query.width = (1 - b.min_x()) * 2;
-        query.height = (1 - b.min_y()) * 2;
-        query.centre.x = 0;
-        query.centre.y = 0;
-        overflow = this->get_leaves_at(query);
+    this->nodes[task.node].count = placed;
 
-        if(!overflow.empty())
+    // the children are nw, ne, sw, se, as in place()
+    const std::size_t first_rest = i;
+    for(; i < task.end; ++i)
+    {
+        if(from[i].robot != NULL)
         {
-            found.insert(found.end(), overflow.begin(), overflow.end());
-            overflow.clear();
+            ++counts[((from[i].x < centre.x) ? 0 : 1) + ((from[i].y > centre.y) ? 0 : 2)];
+            ++rest;
         }
     }
-    else if((b.min_x() < 0.0f) && (b.max_y() > 1.0f))
+
+    if(rest == 0)
+    {
+        return;
+    }
+
+    std::size_t first = __sync_fetch_and_add(&this->node_count, 4);
+    this->divide(task.node, first);
+
+    std::size_t starts[4], next[4];
+    starts[0] = first_rest;
+    for(quadrant = 1; quadrant < 4; ++quadrant)
     {
-        query.width = b.min_x() * (-2);
-        query.height = (1 - b.min_y()) * 2;
-        query.centre.x = 1;
-        query.centre.y = 0;
-        overflow = this->get_leaves_at(query);
+        starts[quadrant] = starts[quadrant - 1] + counts[quadrant - 1];
+    }
+    std::copy(starts, starts + 4, next);
 
-        if(!overflow.empty())
+    for(i = first_rest; i < task.end; ++i)
+    {
+        if(from[i].robot != NULL)
         {
-            found.insert(found.end(), overflow.begin(), overflow.end());
-            overflow.clear();
+            to[next[((from[i].x < centre.x) ? 0 : 1) + ((from[i].y > centre.y) ? 0 : 2)]++] = from[i];
         }
     }
-    else if((b.min_y() < 0.0f) && (b.max_x() > 1.0f))
-    {
-        query.width = (1 - b.min_x()) * 2;
-        query.height = b.min_y() * (-2);
-        query.centre.x = 0;
-        query.centre.y = 1;
-        overflow = this->get_leaves_at(query);
 
-        if(!overflow.empty())
+    for(quadrant = 0; quadrant < 4; ++quadrant)
+    {
+        if(counts[quadrant] > 0)
         {
-            found.insert(found.end(), overflow.begin(), overflow.end());
-            overflow.clear();
+            build_task child = { first + quadrant, starts[quadrant], starts[quadrant] + counts[quadrant], !task.in_scratch };
+            children.push_back(child);
         }
     }
-
-    return found;
 }
 
-// clear all the leaf vectors and then delete the trees
-void QuadTree::clear()
+// fill a node and everything below it
+void QuadTree::fill_subtree(const build_task &task)
 {
-    if(!this->leaves.empty())
-    {
-        this->leaves.clear();
-        std::vector<Uni::Robot *> (this->leaves).swap(this->leaves);
-    }
+    std::vector<build_task> pending(1, task);
 
-    if(this->northwest != NULL)
+    while(!pending.empty())
     {
-        this->northwest->clear();
-        delete this->northwest;
-        this->northwest = NULL;
+        build_task current = pending.back();
+        pending.pop_back();
+        this->fill(current, pending);
     }
+}
+
+void QuadTree::build_job(std::size_t begin, std::size_t end, std::size_t worker, void *data)
+{
+    QuadTree *tree = static_cast<QuadTree *>(data);
 
-    if(this->northeast != NULL)
+    for(; begin < end; ++begin)
     {
-        this->northeast->clear();
-        delete this->northeast;
-        this->northeast = NULL;
+        tree->fill_subtree(tree->build_tasks[begin]);
     }
+}
+
+// divide the bounding box of node n into 4 equal boxes.
+void QuadTree::subdivide(const std::size_t &n)
+{
+    std::size_t first;
 
-    if(this->southwest != NULL)
+    if(!this->free_blocks.empty())
     {
-        this->southwest->clear();
-        delete this->southwest;
-        this->southwest = NULL;
+        first = this->free_blocks.back();
+        this->free_blocks.pop_back();
     }
-
-    if(this->southeast != NULL)
+    else
     {
-        this->southeast->clear();
-        delete this->southeast;
-        this->southeast = NULL;
+        first = this->node_count;
+        this->node_count += 4;
+
+        // only grows the pool the first time the tree gets this big
+        if(this->nodes.size() < this->node_count)
+        {
+            this->nodes.resize(this->node_count);
+            this->leaves.resize(this->nodes.size() * this->max_leaves);
+        }
     }
+
+    this->divide(n, first);
 }
 
-// clear all the leaf vectors but leave the trees intact
-void QuadTree::flush()
+// make nodes [first, first + 4) the children of node n
+void QuadTree::divide(const std::size_t &n, const std::size_t &first)
 {
-    if(!this->leaves.empty())
+    // need to simplify this
+    const box &parent = this->nodes[n].bounds;
+    Uni::real new_width = parent.width/2.0f;
+    Uni::real new_height = parent.height/2.0f;
+    Uni::real half_width = new_width/2.0f;
+    Uni::real half_height = new_height/2.0f;
+    Uni::real x = parent.centre.x;
+    Uni::real y = parent.centre.y;
+
+    this->nodes[first].bounds = box((x - half_width), (y + half_height), new_width, new_height);
+    this->nodes[first + 1].bounds = box((x + half_width), (y + half_height), new_width, new_height);
+    this->nodes[first + 2].bounds = box((x - half_width), (y - half_height), new_width, new_height);
+    this->nodes[first + 3].bounds = box((x + half_width), (y - half_height), new_width, new_height);
+
+    std::size_t i = first;
+    for(; i < (first + 4); ++i)
     {
-        this->leaves.clear();
-        std::vector<Uni::Robot *> (this->leaves).swap(this->leaves);
+        this->nodes[i].count = 0;
+        this->nodes[i].children = 0;
+        this->nodes[i].parent = n;
     }
 
-    if(this->northwest != NULL)
-    {
-        this->northwest->clear();
-    }
+    this->nodes[n].children = first;
+}
 
-    if(this->northeast != NULL)
+// Fold the children of n back into it once they hold few enough leaves, and
+// keep going up the tree. Merging at half of max_leaves keeps a robot moving
+// back and forth from splitting and merging a node every step.
+void QuadTree::merge(std::size_t n)
+{
+    if(this->nodes[n].children == 0)
     {
-        this->northeast->clear();
-    }
+        if(n == 0)
+        {
+            return;
+        }
 
-    if(this->southwest != NULL)
-    {
-        this->southwest->clear();
+        n = this->nodes[n].parent;
     }
 
-    if(this->southeast != NULL)
+    while(true)
     {
-        this->southeast->clear();
+        std::size_t first = this->nodes[n].children;
+        std::size_t total = this->nodes[n].count, child;
+
+        for(child = first; child < (first + 4); ++child)
+        {
+            if(this->nodes[child].children != 0)
+            {
+                return;
+            }
+
+            total += this->nodes[child].count;
+        }
+
+        if(total > (this->max_leaves / 2))
+        {
+            return;
+        }
+
+        node &up = this->nodes[n];
+        leaf *local = &this->leaves[n * this->max_leaves];
+
+        for(child = first; child < (first + 4); ++child)
+        {
+            const leaf *from = &this->leaves[child * this->max_leaves];
+            std::size_t i = 0;
+
+            for(; i < this->nodes[child].count; ++i)
+            {
+                local[up.count] = from[i];
+                if(from[i].handle != NO_HANDLE)
+                {
+                    this->locations[from[i].handle].node = n;
+                    this->locations[from[i].handle].slot = up.count;
+                }
+                ++up.count;
+            }
+        }
+
+        up.children = 0;
+        this->free_blocks.push_back(first);
+
+        if(n == 0)
+        {
+            return;
+        }
+
+        n = up.parent;
     }
 }
 
-size_t QuadTree::get_max_leaves() const
+// set up an empty root node
+void QuadTree::reset()
 {
-    return this->max_leaves;
-}
-
-// PRIVATE FUNCTIONS
+    if(this->nodes.empty())
+    {
+        this->nodes.resize(1);
+        this->leaves.resize(this->max_leaves);
+    }
 
-// divide the current bounding box into 4 equal boxes.
-void QuadTree::subdivide()
-{
-    // need to simplify this
-    double new_width = this->bounds.width/2.0f;
-    double new_height = this->bounds.height/2.0f;
-    double half_width = new_width/2.0f;
-    double half_height = new_height/2.0f;
-    double x = this->bounds.centre.x;
-    double y = this->bounds.centre.y;
-
-    box nw((x - half_width), (y + half_height), new_width, new_height);
-    box ne((x + half_width), (y + half_height), new_width, new_height);
-    box sw((x - half_width), (y - half_height), new_width, new_height);
-    box se((x + half_width), (y - half_height), new_width, new_height);
-
-    this->northwest = new QuadTree(nw, max_leaves);
-    this->northeast = new QuadTree(ne, max_leaves);
-    this->southwest = new QuadTree(sw, max_leaves);
-    this->southeast = new QuadTree(se, max_leaves);
+    this->nodes[0].bounds = this->bounds;
+    this->flush();
 }
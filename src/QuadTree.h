@@ -13,27 +13,29 @@
 #define QUADTREE_H
 
 #include <cmath>
+#include <stdint.h>
 #include <vector>
 
 #include "universe.h"
+#include "ThreadPool.h"
 
 namespace Anton
 {
     // essentially a pair or a tuple for x,y
     struct coord
     {
-        double x, y;
+        Uni::real x, y;
         coord() : x(0), y(0) {}
-        coord(const double &_x, const double &_y) : x(_x), y(_y) {}
+        coord(const Uni::real &_x, const Uni::real &_y) : x(_x), y(_y) {}
     };
 
     // bounding box that encompasses a QuadTree
     struct box
     {
         coord centre;
-        double width, height;
+        Uni::real width, height;
         // constructor with a coord
-        box(const coord &_centre, const double &_width, const double &_height)
+        box(const coord &_centre, const Uni::real &_width, const Uni::real &_height)
         {
             centre = _centre;
             if((_width > 0.0f) && (_height > 0.0f))
@@ -47,8 +49,8 @@ namespace Anton
                 height = 0;
             }
         }
-        // constructor with doubles for centre coordinates
-        box(const double &x, const double &y, const double &_width, const double &_height)
+        // constructor with numbers for centre coordinates
+        box(const Uni::real &x, const Uni::real &y, const Uni::real &_width, const Uni::real &_height)
         {
             centre.x = (x > 0) ? x : 0;
             centre.y = (y > 0) ? y : 0;
@@ -66,15 +68,15 @@ namespace Anton
         }
         box() : width(0), height(0) {}
         bool dimensions_set() const { return (width > 0.0f) && (height > 0.0f); }
-        double min_x() const { return dimensions_set() ? (centre.x - (width/2.0f)) : 0; }
-        double max_x() const { return dimensions_set() ? (centre.x + (width/2.0f)) : 0; }
-        double min_y() const { return dimensions_set() ? (centre.y - (height/2.0f)) : 0; }
-        double max_y() const { return dimensions_set() ? (centre.y + (height/2.0f)) : 0; }
-        bool in_range(const double &value, const double &min, const double &max) const
+        Uni::real min_x() const { return dimensions_set() ? (centre.x - (width/2.0f)) : 0; }
+        Uni::real max_x() const { return dimensions_set() ? (centre.x + (width/2.0f)) : 0; }
+        Uni::real min_y() const { return dimensions_set() ? (centre.y - (height/2.0f)) : 0; }
+        Uni::real max_y() const { return dimensions_set() ? (centre.y + (height/2.0f)) : 0; }
+        bool in_range(const Uni::real &value, const Uni::real &min, const Uni::real &max) const
         {
             return ((value >= min) && (value <= max));
         }
-        bool inside_range(const double &value, const double &min, const double &max) const
+        bool inside_range(const Uni::real &value, const Uni::real &min, const Uni::real &max) const
         {
             return ((value > min) && (value < max));
         }
@@ -88,7 +90,7 @@ namespace Anton
 
             return false;
         }
-        bool contains_coord(const double &x, const double &y) const
+        bool contains_coord(const Uni::real &x, const Uni::real &y) const
         {
             coord p(x, y);
 
@@ -117,32 +119,169 @@ namespace Anton
         }
     };
 
+    const uint32_t NO_HANDLE = 0xffffffff;
+
+    // a robot stored in the tree, along with the position it was inserted at
+    struct leaf
+    {
+        Uni::real x, y;
+        Uni::Robot *robot;
+        uint32_t handle; // set for leaves added with insert_leaf()
+        leaf() : x(0), y(0), robot(NULL), handle(NO_HANDLE) {}
+        leaf(const Uni::real &_x, const Uni::real &_y, Uni::Robot *r) : x(_x), y(_y), robot(r), handle(NO_HANDLE) {}
+        leaf(const Uni::real &_x, const Uni::real &_y, Uni::Robot *r, const uint32_t &h) : x(_x), y(_y), robot(r), handle(h) {}
+    };
+
+    // All nodes live in one pool and all leaves in one flat array, so flushing
+    // the tree between steps keeps every buffer around for the next rebuild.
+    // The bounds of the tree are the world, which wraps around like a torus
+    // for find_in_range() and visit_in_range().
     class QuadTree
     {
         public:
             QuadTree(const box &bounds, const std::size_t &max_leaves);
             virtual ~QuadTree();
             bool add_leaf(Uni::Robot *r);
+            bool add_leaf(Uni::Robot *r, const Uni::real &x, const Uni::real &y);
+            // Replace the contents of the tree with robot ids[k] of robots at
+            // (x[k], y[k]) for every k below count. The top of the tree is
+            // split into subtrees serially, and pool builds those at once. The
+            // tree holds the same leaves in the same nodes as after calling
+            // add_leaf() for each robot in order.
+            void build(const Uni::real *x, const Uni::real *y, Uni::Robot *robots, const uint32_t *ids,
+                       const std::size_t &count, ThreadPool &pool);
             std::vector<Uni::Robot *> get_leaves_at(const coord &p);
-            std::vector<Uni::Robot *> get_leaves_at(const double &x, const double &y);
+            std::vector<Uni::Robot *> get_leaves_at(const Uni::real &x, const Uni::real &y);
             std::vector<Uni::Robot *> get_leaves_at(const box &b);
             std::vector<Uni::Robot *> find_in_range(const coord &p);
-            std::vector<Uni::Robot *> find_in_range(const double &x, const double &y);
+            std::vector<Uni::Robot *> find_in_range(const Uni::real &x, const Uni::real &y);
             std::vector<Uni::Robot *> find_in_range(const box &b);
+            // append any hits to found instead of returning a new vector
+            void get_leaves_at(const box &b, std::vector<Uni::Robot *> &found) const;
+            void find_in_range(const box &b, std::vector<Uni::Robot *> &found) const;
+            // call visit(const leaf &) for every hit
+            template<typename Visitor> void visit_leaves_at(const box &b, Visitor &visit) const;
+            template<typename Visitor> void visit_in_range(const box &b, Visitor &visit) const;
+            // Keep the tree between steps instead of rebuilding it. Each robot
+            // is identified by a small handle, and only robots that leave
+            // the box of their node are moved to another one.
+            bool insert_leaf(const uint32_t &handle, Uni::Robot *r, const Uni::real &x, const Uni::real &y);
+            // A robot outside the world is not in the tree until a later
+            // move_leaf() brings it back. Removing a robot twice does nothing.
+            bool move_leaf(const uint32_t &handle, const Uni::real &x, const Uni::real &y);
+            void remove_leaf(const uint32_t &handle);
             void clear();
             void flush();
             size_t get_max_leaves() const;
+            size_t get_node_count() const;
+            size_t get_moved_count() const;
         protected:
         private:
+            // a quadrant of the tree. Its four children are allocated together
+            // and are stored in the order nw, ne, sw, se.
+            struct node
+            {
+                box bounds;
+                std::size_t count; // number of leaf slots in use
+                std::size_t children; // pool index of the first child, 0 if there are none
+                std::size_t parent;
+            };
+            // where the leaf with a handle is stored. slot is max_leaves while
+            // the robot is not in the tree.
+            struct location
+            {
+                std::size_t node, slot;
+                Uni::Robot *robot;
+            };
+            // a node for build() to fill from items [begin, end) of build_items,
+            // or of build_scratch
+            struct build_task
+            {
+                std::size_t node, begin, end;
+                bool in_scratch;
+            };
             QuadTree();
             QuadTree(const QuadTree &other);
             QuadTree operator=(const QuadTree &other);
-            std::vector<Uni::Robot *> leaves;
+            std::vector<node> nodes; // nodes[0] is the root, the rest are children in blocks of four
+            std::vector<leaf> leaves; // node i owns slots [i * max_leaves, (i + 1) * max_leaves)
+            std::size_t node_count; // nodes in use. The pool may hold more from earlier steps.
+            std::vector<std::size_t> free_blocks; // blocks of four children released by merges
+            std::vector<location> locations; // indexed by handle
+            std::size_t moved_count; // leaves moved to another node since the last flush()
+            std::vector<leaf> build_items, build_scratch; // build() partitions between these
+            std::vector<build_task> build_tasks, build_next;
             box bounds;
             size_t max_leaves; // the max number of elements in leaves before we subdivide the tree
-            QuadTree *northeast, *northwest, *southeast, *southwest;
-            void subdivide();
+            template<typename Visitor> void visit_leaves_at(const std::size_t &n, const box &b, Visitor &visit) const;
+            std::size_t torus_queries(const box &b, box queries[4]) const;
+            bool place(const leaf &l, location &where);
+            void subdivide(const std::size_t &n);
+            void divide(const std::size_t &n, const std::size_t &first);
+            void fill(const build_task &task, std::vector<build_task> &children);
+            void fill_subtree(const build_task &task);
+            static void build_job(std::size_t begin, std::size_t end, std::size_t worker, void *data);
+            void merge(std::size_t n);
+            void reset();
+    };
+
+    // a visitor that appends the robot of every hit to a vector
+    struct robot_collector
+    {
+        std::vector<Uni::Robot *> &found;
+        robot_collector(std::vector<Uni::Robot *> &_found) : found(_found) {}
+        void operator()(const leaf &l) { found.push_back(l.robot); }
     };
+
+    template<typename Visitor>
+    void QuadTree::visit_leaves_at(const box &b, Visitor &visit) const
+    {
+        this->visit_leaves_at(0, b, visit);
+    }
+
+    // Find any robots that may be in the torus range
+    template<typename Visitor>
+    void QuadTree::visit_in_range(const box &b, Visitor &visit) const
+    {
+        box queries[4];
+        std::size_t i = 0, query_count = this->torus_queries(b, queries);
+
+        for(; i < query_count; ++i)
+        {
+            this->visit_leaves_at(0, queries[i], visit);
+        }
+    }
+
+    template<typename Visitor>
+    void QuadTree::visit_leaves_at(const std::size_t &n, const box &b, Visitor &visit) const
+    {
+        const node &current = this->nodes[n];
+
+        if(!current.bounds.intersects(b))
+        {
+            return;   // not in this quadrant
+        }
+
+        const leaf *local = &this->leaves[n * this->max_leaves];
+        std::size_t i = 0, local_leaves = current.count;
+        for(; i < local_leaves; ++i)
+        {
+            if(b.contains_coord(local[i].x, local[i].y))
+            {
+                visit(local[i]);
+            }
+        }
+
+        if(current.children == 0)
+        {
+            return;
+        }
+
+        this->visit_leaves_at(current.children, b, visit);
+        this->visit_leaves_at(current.children + 1, b, visit);
+        this->visit_leaves_at(current.children + 2, b, visit);
+        this->visit_leaves_at(current.children + 3, b, visit);
+    }
 }
 
 #endif // QUADTREE_H
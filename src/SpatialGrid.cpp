@@ -0,0 +1,211 @@
+// ---------------------------------------------------------------------------
+// SpatialGrid.cpp
+// A uniform grid (spatial hash) over the toroidal world.
+//
+// This file is available on Github: https://github.com/antsam/universe
+// ---------------------------------------------------------------------------
+#include "SpatialGrid.h"
+#include <algorithm>
+
+using namespace Anton;
+
+// keeps the cell offsets to a few MB when the range is tiny compared to the world
+const std::size_t MAX_CELLS_PER_SIDE = 1024;
+
+SpatialGrid::SpatialGrid(const Uni::real &worldsize, const Uni::real &range)
+{
+    this->worldsize = worldsize;
+    this->cells_per_side = 1;
+
+    if((range > 0.0f) && (worldsize > range))
+    {
+        this->cells_per_side = (std::size_t)(worldsize / range);
+    }
+
+    if(this->cells_per_side > MAX_CELLS_PER_SIDE)
+    {
+        this->cells_per_side = MAX_CELLS_PER_SIDE;
+    }
+
+    this->cell_size = worldsize / this->cells_per_side;
+
+    std::size_t cells = this->cells_per_side * this->cells_per_side;
+    this->cell_start.resize(cells + 1);
+    this->cell_fill.resize(cells);
+
+    this->starts = &this->cell_start[0];
+    this->sorted = NULL;
+    this->counts = NULL;
+    this->ranks = 1;
+}
+
+SpatialGrid::~SpatialGrid()
+{
+}
+
+void SpatialGrid::build(std::vector<Uni::Robot> &population)
+{
+    const std::size_t population_size = population.size();
+
+    this->xs.resize(population_size);
+    this->ys.resize(population_size);
+
+    std::size_t i = 0;
+    for(; i < population_size; ++i)
+    {
+        this->xs[i] = population[i].pose[0];
+        this->ys[i] = population[i].pose[1];
+    }
+
+    this->build(population_size ? &this->xs[0] : NULL, population_size ? &this->ys[0] : NULL,
+                population_size ? &population[0] : NULL, NULL, population_size);
+}
+
+// sort every robot into its cell. Buffers are only reallocated when the
+// population grows.
+void SpatialGrid::build(const Uni::real *x, const Uni::real *y, Uni::Robot *robots, const uint32_t *ids, const std::size_t &count)
+{
+    const std::size_t cells = this->cells_per_side * this->cells_per_side;
+
+    this->cell_of.resize(count);
+    this->leaves.resize(count);
+    std::fill(this->cell_start.begin(), this->cell_start.end(), 0);
+
+    // count the robots in each cell
+    std::size_t i = 0;
+    for(; i < count; ++i)
+    {
+        std::size_t cell = (this->cell_at(y[i]) * this->cells_per_side) + this->cell_at(x[i]);
+
+        this->cell_of[i] = cell;
+        ++this->cell_start[cell + 1];
+    }
+
+    // turn the counts into offsets
+    for(i = 0; i < cells; ++i)
+    {
+        this->cell_start[i + 1] += this->cell_start[i];
+        this->cell_fill[i] = this->cell_start[i];
+    }
+
+    for(i = 0; i < count; ++i)
+    {
+        this->leaves[this->cell_fill[this->cell_of[i]]++] = leaf(x[i], y[i], &robots[ids ? ids[i] : i]);
+    }
+
+    this->starts = &this->cell_start[0];
+    this->sorted = count ? &this->leaves[0] : NULL;
+}
+
+// the cell offsets, then every process's count of every cell, then the
+// leaves
+std::size_t SpatialGrid::shared_bytes(const std::size_t &count, const std::size_t &ranks) const
+{
+    const std::size_t cells = this->cells_per_side * this->cells_per_side;
+    std::size_t bytes = ((cells + 1) * sizeof(std::size_t)) + (ranks * cells * sizeof(uint32_t));
+
+    bytes = ((bytes + sizeof(leaf) - 1) / sizeof(leaf)) * sizeof(leaf);
+    return bytes + (count * sizeof(leaf));
+}
+
+void SpatialGrid::place(const std::size_t &count, const std::size_t &ranks, void *memory)
+{
+    const std::size_t cells = this->cells_per_side * this->cells_per_side;
+    const std::size_t leaf_bytes = count * sizeof(leaf);
+    char *bytes = static_cast<char *>(memory);
+
+    this->starts = reinterpret_cast<std::size_t *>(bytes);
+    this->counts = reinterpret_cast<uint32_t *>(this->starts + cells + 1);
+    this->sorted = reinterpret_cast<leaf *>(bytes + this->shared_bytes(count, ranks) - leaf_bytes);
+    this->ranks = ranks;
+    std::fill(this->starts, this->starts + cells + 1, 0);
+}
+
+void SpatialGrid::count_slice(const Uni::real *x, const Uni::real *y, const std::size_t &first, const std::size_t &last, const std::size_t &rank)
+{
+    const std::size_t cells = this->cells_per_side * this->cells_per_side;
+    uint32_t *mine = this->counts + (rank * cells);
+
+    this->cell_of.resize(last - first);
+    std::fill(mine, mine + cells, 0);
+
+    std::size_t i = first;
+    for(; i < last; ++i)
+    {
+        std::size_t cell = (this->cell_at(y[i]) * this->cells_per_side) + this->cell_at(x[i]);
+
+        this->cell_of[i - first] = cell;
+        ++mine[cell];
+    }
+}
+
+// every process works out the offsets for itself, and its robots go after
+// those of the processes before it in each cell. Only the first one writes
+// the offsets the others will read.
+void SpatialGrid::fill_slice(const Uni::real *x, const Uni::real *y, Uni::Robot *robots, const uint32_t *ids, const std::size_t &first, const std::size_t &last, const std::size_t &rank)
+{
+    const std::size_t cells = this->cells_per_side * this->cells_per_side;
+    std::size_t cell = 0, r, start = 0, before;
+
+    for(; cell < cells; ++cell)
+    {
+        if(rank == 0)
+        {
+            this->starts[cell] = start;
+        }
+
+        before = start;
+        for(r = 0; r < this->ranks; ++r)
+        {
+            if(r == rank)
+            {
+                before = start;
+            }
+            start += this->counts[(r * cells) + cell];
+        }
+        this->cell_fill[cell] = before;
+    }
+    if(rank == 0)
+    {
+        this->starts[cells] = start;
+    }
+
+    std::size_t i = first;
+    for(; i < last; ++i)
+    {
+        this->sorted[this->cell_fill[this->cell_of[i - first]]++] = leaf(x[i], y[i], &robots[ids ? ids[i] : i]);
+    }
+}
+
+void SpatialGrid::find_in_range(const Uni::real &x, const Uni::real &y, std::vector<Uni::Robot *> &found) const
+{
+    robot_collector collect(found);
+
+    this->visit_in_range(x, y, collect);
+}
+
+std::size_t SpatialGrid::get_cells_per_side() const
+{
+    return this->cells_per_side;
+}
+
+Uni::real SpatialGrid::get_cell_size() const
+{
+    return this->cell_size;
+}
+
+// PRIVATE FUNCTIONS
+
+// the row or column of the cell holding a coordinate
+std::size_t SpatialGrid::cell_at(const Uni::real &value) const
+{
+    if(value <= 0.0f)
+    {
+        return 0;
+    }
+
+    std::size_t cell = (std::size_t)(value / this->cell_size);
+
+    // a robot sitting exactly on the far edge of the world
+    return (cell < this->cells_per_side) ? cell : (this->cells_per_side - 1);
+}
@@ -0,0 +1,100 @@
+// ---------------------------------------------------------------------------
+// SpatialGrid.h
+// A uniform grid (spatial hash) over the toroidal world.
+//
+// The grid is rebuilt from scratch every step with a counting sort, so all
+// of the robots end up in one array ordered by cell. Cells are at least
+// Robot::range wide, so every robot within range of a point lies in the
+// 3x3 block of cells around it.
+//
+// Processes that step slices of one population in shared memory can build
+// a single grid there together: each counts its own robots, and once all
+// of the counts are in, files them. The leaves hold robot pointers, so the
+// population has to be at the same address in every process, as it is
+// after a fork().
+//
+// This file is available on Github: https://github.com/antsam/universe
+// ---------------------------------------------------------------------------
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include <vector>
+
+#include "universe.h"
+#include "QuadTree.h"
+
+namespace Anton
+{
+    class SpatialGrid
+    {
+        public:
+            SpatialGrid(const Uni::real &worldsize, const Uni::real &range);
+            virtual ~SpatialGrid();
+            void build(std::vector<Uni::Robot> &population);
+            // build from positions stored apart from the robots: robots[ids[i]] is at
+            // (x[i], y[i]), or robots[i] is if ids is NULL
+            void build(const Uni::real *x, const Uni::real *y, Uni::Robot *robots, const uint32_t *ids, const std::size_t &count);
+            // bytes of shared memory for a grid of count robots built by ranks processes
+            std::size_t shared_bytes(const std::size_t &count, const std::size_t &ranks) const;
+            // keep the grid in shared memory from now on, at least shared_bytes() long
+            void place(const std::size_t &count, const std::size_t &ranks, void *memory);
+            // count the robots of slots [first, last) into the cells, as process rank
+            void count_slice(const Uni::real *x, const Uni::real *y, const std::size_t &first, const std::size_t &last, const std::size_t &rank);
+            // file the robots counted by count_slice() once every process has
+            // counted. The leaves end up in the order build() puts them in.
+            void fill_slice(const Uni::real *x, const Uni::real *y, Uni::Robot *robots, const uint32_t *ids, const std::size_t &first, const std::size_t &last, const std::size_t &rank);
+            // append every robot in the 3x3 cells around (x, y) to found
+            void find_in_range(const Uni::real &x, const Uni::real &y, std::vector<Uni::Robot *> &found) const;
+            // call visit(const leaf &) for every robot in the 3x3 cells around (x, y)
+            template<typename Visitor> void visit_in_range(const Uni::real &x, const Uni::real &y, Visitor &visit) const;
+            std::size_t get_cells_per_side() const;
+            Uni::real get_cell_size() const;
+        protected:
+        private:
+            SpatialGrid();
+            SpatialGrid(const SpatialGrid &other);
+            SpatialGrid operator=(const SpatialGrid &other);
+            std::size_t cell_at(const Uni::real &value) const;
+            Uni::real worldsize;
+            Uni::real cell_size;
+            std::size_t cells_per_side;
+            std::vector<std::size_t> cell_of; // cell of each robot in the last build
+            std::vector<std::size_t> cell_start; // leaves of cell c are [cell_start[c], cell_start[c + 1])
+            std::vector<std::size_t> cell_fill; // scratch space for the counting sort
+            std::vector<leaf> leaves; // every robot, ordered by cell
+            std::vector<Uni::real> xs, ys; // positions copied out of robot poses
+            std::size_t *starts; // cell_start, or its copy in shared memory
+            leaf *sorted; // leaves, or their copy in shared memory
+            uint32_t *counts; // robots of each process in each cell, in shared memory
+            std::size_t ranks;
+    };
+
+    template<typename Visitor>
+    void SpatialGrid::visit_in_range(const Uni::real &x, const Uni::real &y, Visitor &visit) const
+    {
+        // with fewer than 3 cells per side the neighbours would wrap onto the
+        // same cells more than once, so only visit the distinct ones
+        const std::size_t n = this->cells_per_side;
+        const std::size_t span = (n < 3) ? n : 3;
+        const std::size_t cx = this->cell_at(x), cy = this->cell_at(y);
+
+        std::size_t i = 0, j, row, cell, leaf_index, leaf_end;
+        for(; i < span; ++i)
+        {
+            row = ((cy + n - 1 + i) % n) * n;
+
+            for(j = 0; j < span; ++j)
+            {
+                cell = row + ((cx + n - 1 + j) % n);
+                leaf_end = this->starts[cell + 1];
+
+                for(leaf_index = this->starts[cell]; leaf_index < leaf_end; ++leaf_index)
+                {
+                    visit(this->sorted[leaf_index]);
+                }
+            }
+        }
+    }
+}
+
+#endif // SPATIALGRID_H
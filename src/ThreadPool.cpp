@@ -0,0 +1,149 @@
+// ---------------------------------------------------------------------------
+// ThreadPool.cpp
+// A fixed set of worker threads for splitting loops over the population.
+//
+// This file is available on Github: https://github.com/antsam/universe
+// ---------------------------------------------------------------------------
+#include "ThreadPool.h"
+#include <cstdio>
+#include <cstdlib>
+
+using namespace Anton;
+
+ThreadPool::ThreadPool(const std::size_t &threads)
+    : generation(0),
+        busy(0),
+        stopping(false),
+        fn(NULL),
+        data(NULL),
+        count(0),
+        grain(1),
+        next(0)
+{
+    pthread_mutex_init(&this->lock, NULL);
+    pthread_cond_init(&this->start, NULL);
+    pthread_cond_init(&this->done, NULL);
+
+    // the calling thread is worker 0
+    std::size_t extra = (threads > 1) ? (threads - 1) : 0;
+    this->threads.resize(extra);
+    this->args.resize(extra);
+
+    std::size_t i = 0;
+    for(; i < extra; ++i)
+    {
+        this->args[i].pool = this;
+        this->args[i].worker = i + 1;
+
+        if(pthread_create(&this->threads[i], NULL, worker_main, &this->args[i]) != 0)
+        {
+            fprintf(stderr, "[Uni] Failed to start worker thread %lu.\n", (long unsigned)(i + 1));
+            exit(-1);
+        }
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    pthread_mutex_lock(&this->lock);
+    this->stopping = true;
+    pthread_cond_broadcast(&this->start);
+    pthread_mutex_unlock(&this->lock);
+
+    std::size_t i = 0;
+    for(; i < this->threads.size(); ++i)
+    {
+        pthread_join(this->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&this->done);
+    pthread_cond_destroy(&this->start);
+    pthread_mutex_destroy(&this->lock);
+}
+
+void ThreadPool::parallel_for(const std::size_t &count, const std::size_t &grain, job fn, void *data)
+{
+    if(this->threads.empty())
+    {
+        if(count > 0)
+        {
+            fn(0, count, 0, data);
+        }
+
+        return;
+    }
+
+    pthread_mutex_lock(&this->lock);
+    this->fn = fn;
+    this->data = data;
+    this->count = count;
+    this->grain = (grain > 0) ? grain : 1;
+    this->next = 0;
+    this->busy = this->threads.size();
+    ++this->generation;
+    pthread_cond_broadcast(&this->start);
+    pthread_mutex_unlock(&this->lock);
+
+    this->run_chunks(0);
+
+    pthread_mutex_lock(&this->lock);
+    while(this->busy > 0)
+    {
+        pthread_cond_wait(&this->done, &this->lock);
+    }
+    pthread_mutex_unlock(&this->lock);
+}
+
+std::size_t ThreadPool::get_thread_count() const
+{
+    return this->threads.size() + 1;
+}
+
+// PRIVATE FUNCTIONS
+
+void *ThreadPool::worker_main(void *arg)
+{
+    worker_arg *self = static_cast<worker_arg *>(arg);
+    ThreadPool *pool = self->pool;
+    std::size_t seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while(true)
+    {
+        while((pool->generation == seen) && !pool->stopping)
+        {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+
+        if(pool->stopping)
+        {
+            break;
+        }
+
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool->run_chunks(self->worker);
+
+        pthread_mutex_lock(&pool->lock);
+        if(--pool->busy == 0)
+        {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+// claim chunks until the job runs out of items
+void ThreadPool::run_chunks(const std::size_t &worker)
+{
+    std::size_t begin, end;
+
+    while((begin = __sync_fetch_and_add(&this->next, this->grain)) < this->count)
+    {
+        end = begin + this->grain;
+        this->fn(begin, (end < this->count) ? end : this->count, worker, this->data);
+    }
+}
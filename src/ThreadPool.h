@@ -0,0 +1,60 @@
+// ---------------------------------------------------------------------------
+// ThreadPool.h
+// A fixed set of worker threads for splitting loops over the population.
+//
+// The thread that calls parallel_for() does its share of the work as worker
+// 0, so a pool of one thread runs everything inline.
+//
+// This file is available on Github: https://github.com/antsam/universe
+// ---------------------------------------------------------------------------
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <pthread.h>
+#include <vector>
+
+namespace Anton
+{
+    class ThreadPool
+    {
+        public:
+            // processes items [begin, end) on the given worker (0 to thread count - 1)
+            typedef void (*job)(std::size_t begin, std::size_t end, std::size_t worker, void *data);
+
+            ThreadPool(const std::size_t &threads);
+            virtual ~ThreadPool();
+            // run fn over [0, count) in chunks of grain items and wait for all of them
+            void parallel_for(const std::size_t &count, const std::size_t &grain, job fn, void *data);
+            std::size_t get_thread_count() const;
+        protected:
+        private:
+            ThreadPool();
+            ThreadPool(const ThreadPool &other);
+            ThreadPool operator=(const ThreadPool &other);
+            static void *worker_main(void *arg);
+            void run_chunks(const std::size_t &worker);
+
+            struct worker_arg
+            {
+                ThreadPool *pool;
+                std::size_t worker;
+            };
+
+            std::vector<pthread_t> threads;
+            std::vector<worker_arg> args;
+            pthread_mutex_t lock;
+            pthread_cond_t start; // signalled when a new job is posted
+            pthread_cond_t done; // signalled when the last worker finishes a job
+            std::size_t generation; // bumped for every job
+            std::size_t busy; // workers still running the current job
+            bool stopping;
+
+            // the current job
+            job fn;
+            void *data;
+            std::size_t count, grain;
+            volatile std::size_t next; // first item of the next unclaimed chunk
+    };
+}
+
+#endif // THREADPOOL_H
@@ -0,0 +1,204 @@
+/****
+         checkpoint.cc
+         Saving the state of every robot to a file and starting from one.
+
+         part of universe (https://github.com/antsam/universe)
+****/
+
+#include <cerrno>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "checkpoint.h"
+
+using namespace Uni;
+
+static const char magic[8] = { 'U', 'N', 'I', 'C', 'K', 'P', 'T', '1' };
+static const std::size_t header_bytes = 4096; // the bodies start on a page, so they can be mapped
+
+struct CheckpointHeader
+{
+    char magic[8];
+    uint64_t robots;
+    uint64_t updates;
+    uint64_t bodies_bytes;    // Bodies::Bytes(robots), a check on the layout
+    double worldsize;
+    unsigned short random[3];    // drand48() state
+    uint32_t precision;    // sizeof(real) of the build that wrote it, 0 before there was a choice
+    uint64_t random_seed;    // seed of the robots' RobotRandom, 0 before it was saved
+};
+
+// the drand48() state, left as it was
+static void SaveRandom(unsigned short random[3])
+{
+    unsigned short scratch[3] = { 0, 0, 0 };
+    memcpy(random, seed48(scratch), 3 * sizeof(unsigned short));
+    seed48(random);
+}
+
+bool Uni::SaveCheckpoint(const char* path, const Bodies& bodies, const std::vector<Robot>& population,
+                         uint64_t updates)
+{
+    const std::size_t n = bodies.Size();
+    std::vector<char> header(header_bytes, 0);
+    std::vector<uint8_t> colors(3 * n);
+    CheckpointHeader h;
+    std::size_t k = 0;
+
+    memcpy(h.magic, magic, sizeof(magic));
+    h.robots = n;
+    h.updates = updates;
+    h.bodies_bytes = Bodies::Bytes(n);
+    h.worldsize = worldsize;
+    SaveRandom(h.random);
+    h.precision = sizeof(real);
+    h.random_seed = random_seed;
+    memcpy(&header[0], &h, sizeof(h));
+
+    // colours in slot order, like everything else
+    for(; k < n; ++k)
+    {
+        memcpy(&colors[3 * k], population[bodies.id[k]].color, 3);
+    }
+
+    std::string temporary = std::string(path) + ".tmp";
+    FILE* out = fopen(temporary.c_str(), "wb");
+    if(out == NULL)
+    {
+        fprintf(stderr, "[Uni] Failed to write %s: %s\n", temporary.c_str(), strerror(errno));
+        return false;
+    }
+
+    bool written = (fwrite(&header[0], header_bytes, 1, out) == 1)
+        && ((n == 0) || (fwrite(bodies.Data(), h.bodies_bytes, 1, out) == 1))
+        && ((n == 0) || (fwrite(&colors[0], colors.size(), 1, out) == 1));
+    written = (fclose(out) == 0) && written;
+
+    if(!written || (rename(temporary.c_str(), path) != 0))
+    {
+        fprintf(stderr, "[Uni] Failed to write %s: %s\n", path, strerror(errno));
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+// read the header and check it belongs to a checkpoint of the right size
+static bool ReadHeader(int fd, const char* path, CheckpointHeader& h, std::size_t& file_bytes)
+{
+    struct stat st;
+
+    ssize_t got;
+
+    if((fstat(fd, &st) != 0) || ((got = pread(fd, &h, sizeof(h), 0)) < 0))
+    {
+        fprintf(stderr, "[Uni] Failed to read %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    // the layout of the bodies depends on the precision, so that is only
+    // checked once the file is known to be a checkpoint
+    file_bytes = st.st_size;
+    if((got != (ssize_t)sizeof(h)) || (memcmp(h.magic, magic, sizeof(magic)) != 0))
+    {
+        fprintf(stderr, "[Uni] %s is not a checkpoint.\n", path);
+        return false;
+    }
+
+    if(((h.precision != 0) ? h.precision : sizeof(double)) != sizeof(real))
+    {
+        fprintf(stderr, "[Uni] %s was not written by the %s build.\n", path, UNIVERSE_PRECISION);
+        return false;
+    }
+
+    if((h.bodies_bytes != Bodies::Bytes(h.robots)) || (file_bytes != (header_bytes + h.bodies_bytes + (3 * h.robots))))
+    {
+        fprintf(stderr, "[Uni] %s is not a checkpoint written by this version.\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+bool Uni::ReadCheckpointSize(const char* path, std::size_t& robots, real& worldsize)
+{
+    CheckpointHeader h;
+    std::size_t file_bytes;
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        fprintf(stderr, "[Uni] Failed to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    bool ok = ReadHeader(fd, path, h, file_bytes);
+    close(fd);
+
+    robots = h.robots;
+    worldsize = h.worldsize;
+    return ok;
+}
+
+bool Uni::LoadCheckpoint(const char* path, Bodies& bodies, std::vector<Robot>& population, uint64_t& updates)
+{
+    CheckpointHeader h;
+    std::size_t file_bytes, k = 0;
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        fprintf(stderr, "[Uni] Failed to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    if(!ReadHeader(fd, path, h, file_bytes))
+    {
+        close(fd);
+        return false;
+    }
+
+    if(h.robots != population.size())
+    {
+        fprintf(stderr, "[Uni] %s holds %lu robots, not %lu.\n", path, (long unsigned)h.robots,
+                (long unsigned)population.size());
+        close(fd);
+        return false;
+    }
+
+    // a private mapping, so the simulation can change the bodies without
+    // writing to the file. It lasts as long as the program.
+    void* file = mmap(NULL, file_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(file == MAP_FAILED)
+    {
+        fprintf(stderr, "[Uni] Failed to map %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    char* bytes = static_cast<char*>(file);
+    const uint8_t* colors = reinterpret_cast<const uint8_t*>(bytes + header_bytes + h.bodies_bytes);
+
+    bodies.Place(h.robots, bytes + header_bytes);
+    for(; k < h.robots; ++k)
+    {
+        if(bodies.id[k] >= h.robots)
+        {
+            fprintf(stderr, "[Uni] %s is damaged.\n", path);
+            munmap(file, file_bytes);
+            return false;
+        }
+
+        Robot& r = population[bodies.id[k]];
+        bodies.Store(k, r);
+        memcpy(r.color, &colors[3 * k], 3);
+    }
+
+    updates = h.updates;
+    seed48(h.random);
+    random_seed = h.random_seed;
+    return true;
+}
@@ -0,0 +1,43 @@
+/****
+         checkpoint.h
+         Saving the state of every robot to a file and starting from one.
+
+         part of universe (https://github.com/antsam/universe)
+****/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <vector>
+#include "universe.h"
+
+namespace Uni
+{
+    /** A checkpoint is a page of header (the number of robots, the world
+        size, the step counter, the drand48() state and the seed of the
+        robots' RobotRandom) followed by the block of Bodies arrays
+        exactly as they are in memory, and then the colour of every
+        robot. Loading maps the file and uses the
+        block in place, so only the Robot objects are copied. The format
+        is only meant to be read on the machine that wrote it. */
+
+    /** Write the robots and the step counter to path. The file is
+        replaced in one go, so a crash never leaves half of one behind.
+        Returns false, having said why, if it can't be written. */
+    bool SaveCheckpoint(const char* path, const Bodies& bodies, const std::vector<Robot>& population,
+                        uint64_t updates);
+
+    /** Read the number of robots and the world size from the header of
+        the checkpoint at path. Returns false, having said why, if it isn't
+        one. */
+    bool ReadCheckpointSize(const char* path, std::size_t& robots, real& worldsize);
+
+    /** Map the checkpoint at path, place the bodies in it and copy each
+        robot's pose, speed and colour out to the population, which must
+        already have the right size. Restores the step counter, the
+        drand48() state and random_seed, over any --seed. Returns false,
+        having said why, if it can't. */
+    bool LoadCheckpoint(const char* path, Bodies& bodies, std::vector<Robot>& population, uint64_t& updates);
+}; // namespace Uni
+
+#endif // CHECKPOINT_H
@@ -4,42 +4,7 @@
 		Copyright Richard Vaughan, 2013.1.10
 ****/
 
-#include "universe.h"
-
-static bool invert = false;
-
-// Examine the robot's pixels vector and set the speed sensibly.
-void Controller(Uni::Robot& r, void* dummy_data)
-{
-    r.speed[0] = 0.005;     // constant forward speed
-    r.speed[1] = 0.0;         // no turning. we may change this below
-
-    // steer away from the closest roboot
-    int closest = -1;
-    double dist = r.range; // max sensor range
-
-    const size_t pixel_count = r.pixels.size();
-    unsigned int p = 0;
-    for(; p<pixel_count; ++p)
-    {
-        if(r.pixels[p].range < dist)
-        {
-            closest = (int)p;
-            dist = r.pixels[p].range;
-        }
-    }
-
-    if(closest < 0) // nothing nearby: cruise
-        return;
-
-    if(closest < (int)pixel_count / 2)
-        r.speed[1] = 0.04; // rotate right
-    else
-        r.speed[1] = -0.04; // rotate left
-
-    if(invert)
-        r.speed[1] *= -1.0; // invert turn direction
-}
+#include "swarm.h"
 
 int main( int argc, char* argv[] )
 {
@@ -59,15 +24,17 @@ int main( int argc, char* argv[] )
     }
 
     // configure the robots the way I want 'em
+    Uni::RandomPoses();
     FOR_EACH( r, Uni::population )
     {
-        Uni::RandomPose( r->pose );
-
         // install our callback function
         r->callback = Controller;
         r->callback_data = NULL;
     }
 
+    // steer them all at once, unless --per-robot asks for the callbacks
+    Uni::SetBatchCallback(BatchController, NULL);
+
     // and start the simulation running
     Uni::Run();
 
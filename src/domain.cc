@@ -0,0 +1,317 @@
+/****
+         domain.cc
+         Splitting the world between several processes.
+
+         part of universe (https://github.com/antsam/universe)
+****/
+
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "domain.h"
+
+using namespace Uni;
+
+// a link to a neighbour failed, and this rank can't go on without it
+static void Fail(unsigned int rank, const char* what)
+{
+    fprintf(stderr, "[Uni] rank %u: %s: %s\n", rank, what, (errno != 0) ? strerror(errno) : "neighbour gone");
+    exit(-1);
+}
+
+void Domain::Link::Begin()
+{
+    out.assign(sizeof(uint64_t), 0);
+}
+
+void Domain::Link::Add(const Robot& r)
+{
+    Record record;
+    memset(&record, 0, sizeof(record));
+    memcpy(record.pose, r.pose, sizeof(record.pose));
+    memcpy(record.speed, r.speed, sizeof(record.speed));
+    memcpy(record.color, r.color, sizeof(record.color));
+    record.callback = r.callback;
+    record.callback_data = r.callback_data;
+
+    const char* bytes = reinterpret_cast<const char*>(&record);
+    out.insert(out.end(), bytes, bytes + sizeof(record));
+
+    uint64_t count = (out.size() - sizeof(uint64_t)) / sizeof(Record);
+    memcpy(&out[0], &count, sizeof(count));
+}
+
+std::size_t Domain::Link::Count() const
+{
+    uint64_t count;
+    memcpy(&count, &in[0], sizeof(count));
+    return count;
+}
+
+void Domain::Link::Unpack(std::vector<Robot>& population) const
+{
+    const std::size_t count = Count();
+    std::size_t i = 0;
+    Record record;
+
+    for(; i < count; ++i)
+    {
+        memcpy(&record, &in[sizeof(uint64_t) + (i * sizeof(Record))], sizeof(record));
+
+        population.resize(population.size() + 1);
+        Robot& r = population.back();
+        memcpy(r.pose, record.pose, sizeof(r.pose));
+        memcpy(r.speed, record.speed, sizeof(r.speed));
+        memcpy(r.color, record.color, sizeof(r.color));
+        r.callback = record.callback;
+        r.callback_data = record.callback_data;
+    }
+}
+
+Domain::Domain()
+    : rank(0),
+        ranks(1),
+        lo(0),
+        hi(0)
+{
+}
+
+Domain::~Domain()
+{
+    if(left.fd >= 0)
+        close(left.fd);
+    if(right.fd >= 0)
+        close(right.fd);
+}
+
+void Domain::Split(unsigned int ranks, std::vector<Robot>& population)
+{
+    // link r joins the right side of rank r to the left side of rank r + 1
+    std::vector<int> ends(2 * ranks);
+    unsigned int r = 0, me = 0;
+
+    for(; r < ranks; ++r)
+    {
+        if(socketpair(AF_UNIX, SOCK_STREAM, 0, &ends[2 * r]) != 0)
+        {
+            Fail(0, "socketpair");
+        }
+    }
+
+    // anything still buffered would be written once by every process
+    fflush(stdout);
+    fflush(stderr);
+
+    for(r = 1; r < ranks; ++r)
+    {
+        pid_t pid = fork();
+        if(pid < 0)
+        {
+            Fail(0, "fork");
+        }
+
+        if(pid == 0)
+        {
+            me = r;
+            children.clear();
+            break;
+        }
+        children.push_back(pid);
+    }
+
+    int left_fd = ends[(2 * ((me + ranks - 1) % ranks)) + 1];
+    int right_fd = ends[2 * me];
+    FOR_EACH(it, ends)
+    {
+        if((*it != left_fd) && (*it != right_fd))
+        {
+            close(*it);
+        }
+    }
+
+    Connect(me, ranks, left_fd, right_fd);
+
+    // every process started with every robot
+    std::size_t i = 0, kept = 0;
+    for(; i < population.size(); ++i)
+    {
+        if(RankOf(population[i].pose[0]) == rank)
+        {
+            if(kept != i)
+                population[kept] = population[i];
+            ++kept;
+        }
+    }
+    population.resize(kept);
+}
+
+void Domain::Connect(unsigned int rank, unsigned int ranks, int left_fd, int right_fd)
+{
+    this->rank = rank;
+    this->ranks = ranks;
+    this->lo = (worldsize * rank) / ranks;
+    this->hi = (worldsize * (rank + 1)) / ranks;
+
+    left.fd = left_fd;
+    right.fd = right_fd;
+
+    // Swap() waits for both links at once
+    fcntl(left_fd, F_SETFL, fcntl(left_fd, F_GETFL) | O_NONBLOCK);
+    fcntl(right_fd, F_SETFL, fcntl(right_fd, F_GETFL) | O_NONBLOCK);
+}
+
+unsigned int Domain::RankOf(real x) const
+{
+    // a pose may sit exactly on the far edge of the world
+    unsigned int r = (unsigned int)((x / worldsize) * ranks);
+    return (r < ranks) ? r : (ranks - 1);
+}
+
+std::size_t Domain::Exchange(std::vector<Robot>& population, std::size_t owned, real reach)
+{
+    std::size_t i = 0, kept = 0;
+
+    // hand over the robots that left, the short way round
+    left.Begin();
+    right.Begin();
+    for(; i < owned; ++i)
+    {
+        unsigned int to = RankOf(population[i].pose[0]);
+
+        if(to == rank)
+        {
+            if(kept != i)
+                population[kept] = population[i];
+            ++kept;
+        }
+        else if(((to + ranks - rank) % ranks) <= (ranks / 2))
+        {
+            right.Add(population[i]);
+        }
+        else
+        {
+            left.Add(population[i]);
+        }
+    }
+
+    // the old ghosts go as well
+    population.resize(kept);
+    Swap();
+    left.Unpack(population);
+    right.Unpack(population);
+    owned = population.size();
+
+    // copy the robots near each border to the neighbour across it
+    left.Begin();
+    right.Begin();
+    for(i = 0; i < owned; ++i)
+    {
+        const real x = population[i].pose[0];
+
+        if((x - lo) <= reach)
+            left.Add(population[i]);
+        if((hi - x) <= reach)
+            right.Add(population[i]);
+    }
+
+    Swap();
+    left.Unpack(population);
+    right.Unpack(population);
+
+    return owned;
+}
+
+void Domain::Swap()
+{
+    Link* links[2] = { &left, &right };
+    struct pollfd fds[2];
+    unsigned int i, busy;
+    ssize_t n;
+
+    for(i = 0; i < 2; ++i)
+    {
+        links[i]->in.resize(sizeof(uint64_t));
+        links[i]->sent = 0;
+        links[i]->received = 0;
+        links[i]->sized = false;
+    }
+
+    while(true)
+    {
+        for(i = 0, busy = 0; i < 2; ++i)
+        {
+            fds[i].events = ((links[i]->sent < links[i]->out.size()) ? POLLOUT : 0)
+                | ((links[i]->received < links[i]->in.size()) ? POLLIN : 0);
+            fds[i].revents = 0;
+            busy += (fds[i].events != 0);
+
+            // a neighbour that is done may hang up before this rank is
+            fds[i].fd = (fds[i].events != 0) ? links[i]->fd : -1;
+        }
+
+        if(busy == 0)
+        {
+            return;
+        }
+
+        if(poll(fds, 2, -1) < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            Fail(rank, "poll");
+        }
+
+        for(i = 0; i < 2; ++i)
+        {
+            Link& l = *links[i];
+            errno = 0;
+
+            if(fds[i].revents & POLLOUT)
+            {
+                n = send(l.fd, &l.out[l.sent], l.out.size() - l.sent, MSG_NOSIGNAL);
+                if(n > 0)
+                    l.sent += n;
+                else if((errno != EAGAIN) && (errno != EINTR))
+                    Fail(rank, "send");
+            }
+
+            if(fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                if(l.received == l.in.size())
+                {
+                    Fail(rank, "link"); // hung up with nothing left to read
+                }
+
+                n = recv(l.fd, &l.in[l.received], l.in.size() - l.received, 0);
+                if(n > 0)
+                    l.received += n;
+                else if((n == 0) || ((errno != EAGAIN) && (errno != EINTR)))
+                    Fail(rank, "recv");
+
+                // the count says how much more is coming
+                if(!l.sized && (l.received == sizeof(uint64_t)))
+                {
+                    l.sized = true;
+                    l.in.resize(sizeof(uint64_t) + (l.Count() * sizeof(Record)));
+                }
+            }
+        }
+    }
+}
+
+void Domain::Wait()
+{
+    int status;
+
+    FOR_EACH(it, children)
+    {
+        if((waitpid(*it, &status, 0) == *it) && !(WIFEXITED(status) && (WEXITSTATUS(status) == 0)))
+        {
+            fprintf(stderr, "[Uni] rank %u exited abnormally.\n", (unsigned int)(it - children.begin()) + 1);
+        }
+    }
+    children.clear();
+}
@@ -0,0 +1,100 @@
+/****
+         domain.h
+         Splitting the world between several processes.
+
+         part of universe (https://github.com/antsam/universe)
+****/
+
+#ifndef DOMAIN_H
+#define DOMAIN_H
+
+#include <vector>
+#include <sys/types.h>
+#include "universe.h"
+
+namespace Uni
+{
+    /** The world cut into vertical strips of equal width, one per process
+        (rank). Each rank steps only the robots in its own strip. Robots
+        within reach of a border are copied to the neighbour on that side
+        as ghosts every step, so it can sense them, and robots that cross
+        a border are handed over to the neighbour.
+
+        Neighbours talk over UNIX domain sockets. All of the ranks are
+        forked from one process, so robots are sent as raw bytes, callback
+        pointers included. A strip must be at least twice the reach wide. */
+    class Domain
+    {
+    public:
+        unsigned int rank;    // this process, 0 to ranks - 1
+        unsigned int ranks;    // number of processes
+        real lo, hi;    // the strip of the world owned here, [lo, hi)
+
+        Domain();
+        ~Domain();
+
+        /** Is the world split at all? */
+        bool Active() const { return ranks > 1; }
+
+        /** Fork ranks - 1 more processes and connect each one to its
+            neighbours. Returns in every process, with the population cut
+            down to the robots in its strip. */
+        void Split(unsigned int ranks, std::vector<Robot>& population);
+
+        /** Use fds as the links to the neighbours at either side, without
+            forking. Split() calls this. */
+        void Connect(unsigned int rank, unsigned int ranks, int left_fd, int right_fd);
+
+        /** Rank owning the strip around x. */
+        unsigned int RankOf(real x) const;
+
+        /** Hand over the robots that left the strip and swap ghosts with
+            the neighbours. population holds the owned robots, then the
+            ghosts of the last step. On return it holds the owned robots,
+            then the ghosts of robots within reach of this strip. Returns
+            the number owned. Blocks until both neighbours have done the
+            same. */
+        std::size_t Exchange(std::vector<Robot>& population, std::size_t owned, real reach);
+
+        /** Wait for the other ranks to exit. Only rank 0 has any. */
+        void Wait();
+
+    private:
+        Domain(const Domain& other);
+        Domain& operator=(const Domain& other);
+
+        // a robot as it is sent: everything but the sensor
+        struct Record
+        {
+            real pose[3];
+            real speed[2];
+            uint8_t color[3];
+            void (*callback)(Robot& r, void* user);
+            void* callback_data;
+        };
+
+        // one message each way with a neighbour, a count and then records
+        struct Link
+        {
+            int fd;
+            std::vector<char> out;
+            std::vector<char> in;
+            std::size_t sent, received;
+            bool sized;    // the count of the incoming message is in
+
+            Link() : fd(-1), sent(0), received(0), sized(false) {}
+            void Begin();
+            void Add(const Robot& r);
+            std::size_t Count() const;
+            void Unpack(std::vector<Robot>& population) const;
+        };
+
+        // send both outgoing messages and receive both incoming ones
+        void Swap();
+
+        Link left, right;
+        std::vector<pid_t> children;
+    };
+}; // namespace Uni
+
+#endif // DOMAIN_H
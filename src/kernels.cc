@@ -0,0 +1,401 @@
+/****
+         kernels.cc
+         Vectorized inner loops of the sensor update.
+
+         part of universe (https://github.com/antsam/universe)
+****/
+
+#include <cmath>
+#include <cstring>
+#include "kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define X86_KERNELS 1
+    #include <immintrin.h>
+#else
+    #define X86_KERNELS 0
+#endif
+
+namespace Uni
+{
+    FilterKernel FilterInRange(FilterInRangeScalar);
+    static const char* filter_name = "scalar";
+}
+
+using namespace Uni;
+
+// squared cut-off distance, a little past range so rounding in the squares
+// can never throw away a robot that hypot() would keep
+static inline real CutSquared(real range)
+{
+    real cut = range * (real)(1.0 + 1e-6);
+    return cut * cut;
+}
+
+// offset from a to b on a torus of side worldsize. Matches the wrap in the
+// original sensor loop exactly.
+static inline real Wrap(real d, real half, real worldsize)
+{
+    if(d > half)
+        d -= worldsize;
+    else if(d < -half)
+        d += worldsize;
+    return d;
+}
+
+// filter candidates [begin, n). Stores every candidate and only advances
+// past the ones that survive, so there is no branch on the distance.
+static inline std::size_t FilterTail(const real* xs, const real* ys, std::size_t begin, std::size_t n,
+                                     real x, real y, real worldsize, real cut,
+                                     uint32_t* keep, real* dx, real* dy, std::size_t count)
+{
+    const real half = worldsize / 2;
+    real ox, oy;
+
+    for(; begin < n; ++begin)
+    {
+        ox = Wrap(xs[begin] - x, half, worldsize);
+        oy = Wrap(ys[begin] - y, half, worldsize);
+
+        keep[count] = begin;
+        dx[count] = ox;
+        dy[count] = oy;
+        count += ((ox * ox) + (oy * oy)) <= cut;
+    }
+
+    return count;
+}
+
+std::size_t Uni::FilterInRangeScalar(const real* xs, const real* ys, std::size_t n,
+                                     real x, real y, real worldsize, real range,
+                                     uint32_t* keep, real* dx, real* dy)
+{
+    return FilterTail(xs, ys, 0, n, x, y, worldsize, CutSquared(range), keep, dx, dy, 0);
+}
+
+#if X86_KERNELS
+
+#ifndef UNIVERSE_FLOAT
+
+// 4 candidates at a time. AVX2 has no compress, so survivors are picked out
+// of the lane mask.
+__attribute__((target("avx2")))
+static std::size_t FilterInRangeAVX2(const double* xs, const double* ys, std::size_t n,
+                                     double x, double y, double worldsize, double range,
+                                     uint32_t* keep, double* dx, double* dy)
+{
+    const double cut = CutSquared(range);
+    const __m256d vx = _mm256_set1_pd(x);
+    const __m256d vy = _mm256_set1_pd(y);
+    const __m256d vworld = _mm256_set1_pd(worldsize);
+    const __m256d vhalf = _mm256_set1_pd(worldsize * 0.5);
+    const __m256d vnhalf = _mm256_set1_pd(-worldsize * 0.5);
+    const __m256d vcut = _mm256_set1_pd(cut);
+
+    double ox[4], oy[4];
+    std::size_t i = 0, count = 0;
+    __m256d vdx, vdy, over, under, d2;
+    int mask, lane;
+
+    for(; (i + 4) <= n; i += 4)
+    {
+        // wrap around torus, without branches
+        vdx = _mm256_sub_pd(_mm256_loadu_pd(xs + i), vx);
+        over = _mm256_cmp_pd(vdx, vhalf, _CMP_GT_OQ);
+        under = _mm256_cmp_pd(vdx, vnhalf, _CMP_LT_OQ);
+        vdx = _mm256_blendv_pd(vdx, _mm256_sub_pd(vdx, vworld), over);
+        vdx = _mm256_blendv_pd(vdx, _mm256_add_pd(vdx, vworld), under);
+
+        vdy = _mm256_sub_pd(_mm256_loadu_pd(ys + i), vy);
+        over = _mm256_cmp_pd(vdy, vhalf, _CMP_GT_OQ);
+        under = _mm256_cmp_pd(vdy, vnhalf, _CMP_LT_OQ);
+        vdy = _mm256_blendv_pd(vdy, _mm256_sub_pd(vdy, vworld), over);
+        vdy = _mm256_blendv_pd(vdy, _mm256_add_pd(vdy, vworld), under);
+
+        d2 = _mm256_add_pd(_mm256_mul_pd(vdx, vdx), _mm256_mul_pd(vdy, vdy));
+        mask = _mm256_movemask_pd(_mm256_cmp_pd(d2, vcut, _CMP_LE_OQ));
+
+        if(mask == 0)
+        {
+            continue; // the common case
+        }
+
+        _mm256_storeu_pd(ox, vdx);
+        _mm256_storeu_pd(oy, vdy);
+
+        while(mask)
+        {
+            lane = __builtin_ctz(mask);
+            keep[count] = i + lane;
+            dx[count] = ox[lane];
+            dy[count] = oy[lane];
+            ++count;
+            mask &= mask - 1;
+        }
+    }
+
+    return FilterTail(xs, ys, i, n, x, y, worldsize, cut, keep, dx, dy, count);
+}
+
+// 8 candidates at a time, with the survivors compressed straight into the
+// output arrays.
+__attribute__((target("avx512f")))
+static std::size_t FilterInRangeAVX512(const double* xs, const double* ys, std::size_t n,
+                                       double x, double y, double worldsize, double range,
+                                       uint32_t* keep, double* dx, double* dy)
+{
+    const double cut = CutSquared(range);
+    const __m512d vx = _mm512_set1_pd(x);
+    const __m512d vy = _mm512_set1_pd(y);
+    const __m512d vworld = _mm512_set1_pd(worldsize);
+    const __m512d vhalf = _mm512_set1_pd(worldsize * 0.5);
+    const __m512d vnhalf = _mm512_set1_pd(-worldsize * 0.5);
+    const __m512d vcut = _mm512_set1_pd(cut);
+    const __m512i lanes = _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+
+    std::size_t i = 0, count = 0;
+    __m512d vdx, vdy, d2;
+    __mmask8 over, under, mask;
+
+    for(; (i + 8) <= n; i += 8)
+    {
+        // wrap around torus, without branches
+        vdx = _mm512_sub_pd(_mm512_loadu_pd(xs + i), vx);
+        over = _mm512_cmp_pd_mask(vdx, vhalf, _CMP_GT_OQ);
+        under = _mm512_cmp_pd_mask(vdx, vnhalf, _CMP_LT_OQ);
+        vdx = _mm512_mask_sub_pd(vdx, over, vdx, vworld);
+        vdx = _mm512_mask_add_pd(vdx, under, vdx, vworld);
+
+        vdy = _mm512_sub_pd(_mm512_loadu_pd(ys + i), vy);
+        over = _mm512_cmp_pd_mask(vdy, vhalf, _CMP_GT_OQ);
+        under = _mm512_cmp_pd_mask(vdy, vnhalf, _CMP_LT_OQ);
+        vdy = _mm512_mask_sub_pd(vdy, over, vdy, vworld);
+        vdy = _mm512_mask_add_pd(vdy, under, vdy, vworld);
+
+        d2 = _mm512_add_pd(_mm512_mul_pd(vdx, vdx), _mm512_mul_pd(vdy, vdy));
+        mask = _mm512_cmp_pd_mask(d2, vcut, _CMP_LE_OQ);
+
+        if(mask == 0)
+        {
+            continue; // the common case
+        }
+
+        _mm512_mask_compressstoreu_pd(dx + count, mask, vdx);
+        _mm512_mask_compressstoreu_pd(dy + count, mask, vdy);
+        _mm512_mask_compressstoreu_epi32(keep + count, (__mmask16)mask,
+                                         _mm512_add_epi32(lanes, _mm512_set1_epi32((int)i)));
+        count += __builtin_popcount(mask);
+    }
+
+    return FilterTail(xs, ys, i, n, x, y, worldsize, cut, keep, dx, dy, count);
+}
+
+#else // UNIVERSE_FLOAT
+
+// 8 candidates at a time. AVX2 has no compress, so survivors are picked out
+// of the lane mask.
+__attribute__((target("avx2")))
+static std::size_t FilterInRangeAVX2(const float* xs, const float* ys, std::size_t n,
+                                     float x, float y, float worldsize, float range,
+                                     uint32_t* keep, float* dx, float* dy)
+{
+    const float cut = CutSquared(range);
+    const __m256 vx = _mm256_set1_ps(x);
+    const __m256 vy = _mm256_set1_ps(y);
+    const __m256 vworld = _mm256_set1_ps(worldsize);
+    const __m256 vhalf = _mm256_set1_ps(worldsize / 2);
+    const __m256 vnhalf = _mm256_set1_ps(-worldsize / 2);
+    const __m256 vcut = _mm256_set1_ps(cut);
+
+    float ox[8], oy[8];
+    std::size_t i = 0, count = 0;
+    __m256 vdx, vdy, over, under, d2;
+    int mask, lane;
+
+    for(; (i + 8) <= n; i += 8)
+    {
+        // wrap around torus, without branches
+        vdx = _mm256_sub_ps(_mm256_loadu_ps(xs + i), vx);
+        over = _mm256_cmp_ps(vdx, vhalf, _CMP_GT_OQ);
+        under = _mm256_cmp_ps(vdx, vnhalf, _CMP_LT_OQ);
+        vdx = _mm256_blendv_ps(vdx, _mm256_sub_ps(vdx, vworld), over);
+        vdx = _mm256_blendv_ps(vdx, _mm256_add_ps(vdx, vworld), under);
+
+        vdy = _mm256_sub_ps(_mm256_loadu_ps(ys + i), vy);
+        over = _mm256_cmp_ps(vdy, vhalf, _CMP_GT_OQ);
+        under = _mm256_cmp_ps(vdy, vnhalf, _CMP_LT_OQ);
+        vdy = _mm256_blendv_ps(vdy, _mm256_sub_ps(vdy, vworld), over);
+        vdy = _mm256_blendv_ps(vdy, _mm256_add_ps(vdy, vworld), under);
+
+        d2 = _mm256_add_ps(_mm256_mul_ps(vdx, vdx), _mm256_mul_ps(vdy, vdy));
+        mask = _mm256_movemask_ps(_mm256_cmp_ps(d2, vcut, _CMP_LE_OQ));
+
+        if(mask == 0)
+        {
+            continue; // the common case
+        }
+
+        _mm256_storeu_ps(ox, vdx);
+        _mm256_storeu_ps(oy, vdy);
+
+        while(mask)
+        {
+            lane = __builtin_ctz(mask);
+            keep[count] = i + lane;
+            dx[count] = ox[lane];
+            dy[count] = oy[lane];
+            ++count;
+            mask &= mask - 1;
+        }
+    }
+
+    return FilterTail(xs, ys, i, n, x, y, worldsize, cut, keep, dx, dy, count);
+}
+
+// 16 candidates at a time, with the survivors compressed straight into the
+// output arrays.
+__attribute__((target("avx512f")))
+static std::size_t FilterInRangeAVX512(const float* xs, const float* ys, std::size_t n,
+                                       float x, float y, float worldsize, float range,
+                                       uint32_t* keep, float* dx, float* dy)
+{
+    const float cut = CutSquared(range);
+    const __m512 vx = _mm512_set1_ps(x);
+    const __m512 vy = _mm512_set1_ps(y);
+    const __m512 vworld = _mm512_set1_ps(worldsize);
+    const __m512 vhalf = _mm512_set1_ps(worldsize / 2);
+    const __m512 vnhalf = _mm512_set1_ps(-worldsize / 2);
+    const __m512 vcut = _mm512_set1_ps(cut);
+    const __m512i lanes = _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+
+    std::size_t i = 0, count = 0;
+    __m512 vdx, vdy, d2;
+    __mmask16 over, under, mask;
+
+    for(; (i + 16) <= n; i += 16)
+    {
+        // wrap around torus, without branches
+        vdx = _mm512_sub_ps(_mm512_loadu_ps(xs + i), vx);
+        over = _mm512_cmp_ps_mask(vdx, vhalf, _CMP_GT_OQ);
+        under = _mm512_cmp_ps_mask(vdx, vnhalf, _CMP_LT_OQ);
+        vdx = _mm512_mask_sub_ps(vdx, over, vdx, vworld);
+        vdx = _mm512_mask_add_ps(vdx, under, vdx, vworld);
+
+        vdy = _mm512_sub_ps(_mm512_loadu_ps(ys + i), vy);
+        over = _mm512_cmp_ps_mask(vdy, vhalf, _CMP_GT_OQ);
+        under = _mm512_cmp_ps_mask(vdy, vnhalf, _CMP_LT_OQ);
+        vdy = _mm512_mask_sub_ps(vdy, over, vdy, vworld);
+        vdy = _mm512_mask_add_ps(vdy, under, vdy, vworld);
+
+        d2 = _mm512_add_ps(_mm512_mul_ps(vdx, vdx), _mm512_mul_ps(vdy, vdy));
+        mask = _mm512_cmp_ps_mask(d2, vcut, _CMP_LE_OQ);
+
+        if(mask == 0)
+        {
+            continue; // the common case
+        }
+
+        _mm512_mask_compressstoreu_ps(dx + count, mask, vdx);
+        _mm512_mask_compressstoreu_ps(dy + count, mask, vdy);
+        _mm512_mask_compressstoreu_epi32(keep + count, mask,
+                                         _mm512_add_epi32(lanes, _mm512_set1_epi32((int)i)));
+        count += __builtin_popcount(mask);
+    }
+
+    return FilterTail(xs, ys, i, n, x, y, worldsize, cut, keep, dx, dy, count);
+}
+
+#endif // UNIVERSE_FLOAT
+
+#endif // X86_KERNELS
+
+bool Uni::SelectFilterKernel(const char* name)
+{
+#if X86_KERNELS
+    __builtin_cpu_init();
+    bool avx512 = __builtin_cpu_supports("avx512f");
+    bool avx2 = __builtin_cpu_supports("avx2");
+
+    if(((name == NULL) || (strcmp(name, "avx512") == 0)) && avx512)
+    {
+        FilterInRange = FilterInRangeAVX512;
+        filter_name = "avx512";
+        return true;
+    }
+
+    if(((name == NULL) || (strcmp(name, "avx2") == 0)) && avx2)
+    {
+        FilterInRange = FilterInRangeAVX2;
+        filter_name = "avx2";
+        return true;
+    }
+#endif
+
+    if((name == NULL) || (strcmp(name, "scalar") == 0))
+    {
+        FilterInRange = FilterInRangeScalar;
+        filter_name = "scalar";
+        return true;
+    }
+
+    return false;
+}
+
+const char* Uni::FilterKernelName()
+{
+    return filter_name;
+}
+
+void SectorTable::Setup(real fov, unsigned int pixel_count)
+{
+    this->pixel_count = (pixel_count > 0) ? pixel_count : 1;
+
+    double half_fov = fov / 2.0;
+    wide = (half_fov >= M_PI);
+    half_x = cos(half_fov);
+    half_y = sin(half_fov);
+
+    // pixels are bounded at every multiple of radians_per_pixel from straight
+    // ahead. A direction below the x axis is mirrored into the upper half, so
+    // only the boundaries from 0 to M_PI are needed.
+    double radians_per_pixel = fov / (double)this->pixel_count;
+    unsigned int m = 1;
+
+    bx.clear();
+    by.clear();
+    for(; (m * radians_per_pixel) <= M_PI; ++m)
+    {
+        bx.push_back(cos(m * radians_per_pixel));
+        by.push_back(sin(m * radians_per_pixel));
+    }
+}
+
+bool SectorTable::Bin(real rx, real ry, int& pixel) const
+{
+    // both sides of the sensor are handled in the upper half plane, where
+    // the sign of a cross product orders directions by angle
+    real fy = std::fabs(ry);
+
+    // discard if it's out of field of view
+    if(!wide && (((half_x * fy) - (half_y * rx)) > 0))
+    {
+        return false;
+    }
+
+    // count the boundaries at or before the direction
+    std::size_t lo = 0, hi = bx.size(), mid;
+    while(lo < hi)
+    {
+        mid = (lo + hi) / 2;
+        if(((bx[mid] * fy) - (by[mid] * rx)) >= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    // same as floor(relative_heading / radians_per_pixel) + pixel_count / 2
+    int sector = (ry < 0) ? -(int)lo - 1 : (int)lo;
+    pixel = sector + (int)(pixel_count / 2);
+    pixel %= (int)pixel_count;
+    return true;
+}
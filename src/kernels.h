@@ -0,0 +1,68 @@
+/****
+         kernels.h
+         Vectorized inner loops of the sensor update.
+
+         part of universe (https://github.com/antsam/universe)
+****/
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+#include "precision.h"
+
+namespace Uni
+{
+    /** Keeps the candidates at (xs[i], ys[i]) that may be within range of
+        (x, y) on a torus of side worldsize. For each survivor, its position
+        in the candidate arrays goes to keep and its wrapped offset from
+        (x, y) to dx and dy. Returns the number of survivors.
+
+        The distance cut is a little generous, so callers still need to
+        check the exact distance of each survivor. */
+    typedef std::size_t (*FilterKernel)(const real* xs, const real* ys, std::size_t n,
+                                        real x, real y, real worldsize, real range,
+                                        uint32_t* keep, real* dx, real* dy);
+
+    /** The fastest kernel this CPU supports. Set by SelectFilterKernel(). */
+    extern FilterKernel FilterInRange;
+
+    /** Pick a kernel by name ("avx512", "avx2" or "scalar"), or the fastest
+        supported one if name is NULL. Returns false if the CPU can't run it. */
+    bool SelectFilterKernel(const char* name);
+
+    /** Name of the kernel FilterInRange points at. */
+    const char* FilterKernelName();
+
+    std::size_t FilterInRangeScalar(const real* xs, const real* ys, std::size_t n,
+                                    real x, real y, real worldsize, real range,
+                                    uint32_t* keep, real* dx, real* dy);
+
+    /** Sector boundaries of the sensor, for finding the pixel that sees a
+        direction with cross products instead of atan2(). */
+    class SectorTable
+    {
+    public:
+        SectorTable() : pixel_count(1), wide(true), half_x(-1), half_y(0) {}
+
+        /** Work out the boundaries for a sensor configuration. */
+        void Setup(real fov, unsigned int pixel_count);
+
+        /** Find the pixel that sees direction (rx, ry), given in the
+            robot's frame (x forward). Returns false if it is outside the
+            field of view. Agrees with the atan2() binning except for
+            directions within rounding error of a boundary. */
+        bool Bin(real rx, real ry, int& pixel) const;
+
+    private:
+        unsigned int pixel_count;
+        bool wide;    // the field of view is a full circle
+        real half_x, half_y;    // direction of the edge of the field of view
+        // boundaries between 0 and M_PI, folded so one table serves both sides
+        std::vector<real> bx, by;
+    };
+}; // namespace Uni
+
+#endif // KERNELS_H
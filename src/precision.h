@@ -0,0 +1,26 @@
+/****
+         precision.h
+         The floating point type of the simulation core.
+
+         part of universe (https://github.com/antsam/universe)
+****/
+
+#ifndef PRECISION_H
+#define PRECISION_H
+
+namespace Uni
+{
+    /** Poses, speeds, ranges and spatial index coordinates are all of
+        this type. It is double unless the engine is built with
+        UNIVERSE_FLOAT defined (cmake -DUNIVERSE_FLOAT=ON), which halves
+        the bytes per robot and doubles the lanes of the range filters. */
+#ifdef UNIVERSE_FLOAT
+    typedef float real;
+    #define UNIVERSE_PRECISION "float"
+#else
+    typedef double real;
+    #define UNIVERSE_PRECISION "double"
+#endif
+}; // namespace Uni
+
+#endif // PRECISION_H
@@ -0,0 +1,95 @@
+/****
+         random.h
+         Random numbers that depend only on who draws them and when.
+
+         part of universe (https://github.com/antsam/universe)
+****/
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+namespace Uni
+{
+    extern uint64_t random_seed; // seed of every RobotRandom, set with --seed
+
+    /** The Philox4x32-10 counter-based generator (Salmon et al., "Parallel
+        random numbers: as easy as 1, 2, 3", SC 2011). Scrambles counter
+        with key into four random words. The same counter and key always
+        give the same words, so any thread can draw any robot's numbers
+        in any order. */
+    inline void Philox(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4])
+    {
+        uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+        uint32_t k0 = key[0], k1 = key[1];
+        unsigned int round = 0;
+
+        for(; round < 10; ++round)
+        {
+            uint64_t p0 = (uint64_t)0xD2511F53U * c0;
+            uint64_t p1 = (uint64_t)0xCD9E8D57U * c2;
+
+            c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+            c1 = (uint32_t)p1;
+            c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+            c3 = (uint32_t)p0;
+
+            k0 += 0x9E3779B9U;
+            k1 += 0xBB67AE85U;
+        }
+
+        out[0] = c0;
+        out[1] = c1;
+        out[2] = c2;
+        out[3] = c3;
+    }
+
+    /** The random numbers of one robot at one step. Two RobotRandoms with
+        the same seed, robot and step draw the same numbers, however many
+        threads or processes there are. Steps are counted modulo 2^32. */
+    class RobotRandom
+    {
+    public:
+        RobotRandom(uint64_t id, uint64_t step) { Start(random_seed, id, step); }
+        RobotRandom(uint64_t seed, uint64_t id, uint64_t step) { Start(seed, id, step); }
+
+        /** 32 random bits. */
+        uint32_t Next()
+        {
+            if(used == 4)
+            {
+                Philox(counter, key, block);
+                ++counter[0];
+                used = 0;
+            }
+            return block[used++];
+        }
+
+        /** Uniform in [0, 1), with 53 random bits. */
+        double Uniform()
+        {
+            uint64_t high = Next() >> 5, low = Next() >> 6;
+            return ((high << 26) | low) * (1.0 / 9007199254740992.0);
+        }
+
+    private:
+        void Start(uint64_t seed, uint64_t id, uint64_t step)
+        {
+            counter[0] = 0;    // block of numbers drawn so far
+            counter[1] = (uint32_t)step;
+            counter[2] = (uint32_t)id;
+            counter[3] = (uint32_t)(id >> 32);
+            key[0] = (uint32_t)seed;
+            key[1] = (uint32_t)(seed >> 32);
+            used = 4;
+        }
+
+        uint32_t counter[4];
+        uint32_t key[2];
+        uint32_t block[4];
+        unsigned int used;    // words of block already handed out
+    };
+}; // namespace Uni
+
+#endif // RANDOM_H
@@ -0,0 +1,167 @@
+/****
+         shared.cc
+         Several processes stepping one population in shared memory.
+
+         part of universe (https://github.com/antsam/universe)
+****/
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "shared.h"
+
+using namespace Uni;
+
+static const std::size_t header_bytes = 64;
+
+SharedBodies::SharedBodies()
+    : rank(0),
+        ranks(1),
+        first(0),
+        last(0),
+        header(NULL),
+        index(NULL),
+        bytes(0)
+{
+}
+
+SharedBodies::~SharedBodies()
+{
+    if(header != NULL)
+        munmap(header, bytes);
+}
+
+void SharedBodies::Split(unsigned int ranks, Bodies& bodies, const std::vector<Robot>& population, std::size_t index_bytes)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/universe-%d", (int)getpid());
+
+    // the name is only needed until the segment is mapped, and the other
+    // processes get the mapping by forking
+    bytes = header_bytes + Bodies::Bytes(population.size()) + index_bytes;
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if((fd < 0) || (ftruncate(fd, bytes) != 0))
+    {
+        fprintf(stderr, "[Uni] Failed to make shared memory %s: %s\n", name, strerror(errno));
+        exit(-1);
+    }
+
+    void* segment = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    shm_unlink(name);
+    if(segment == MAP_FAILED)
+    {
+        fprintf(stderr, "[Uni] Failed to map shared memory %s: %s\n", name, strerror(errno));
+        exit(-1);
+    }
+
+    header = static_cast<Header*>(segment);
+    header->arrived = 0;
+    header->generation = 0;
+    header->failed = 0;
+    header->parent = getpid();
+
+    bodies.Place(population.size(), static_cast<char*>(segment) + header_bytes);
+    index = static_cast<char*>(segment) + header_bytes + Bodies::Bytes(population.size());
+    bodies.Load(population);
+
+    // anything still buffered would be written once by every process
+    fflush(stdout);
+    fflush(stderr);
+
+    unsigned int r = 1, me = 0;
+    for(; r < ranks; ++r)
+    {
+        pid_t pid = fork();
+        if(pid < 0)
+        {
+            fprintf(stderr, "[Uni] Failed to fork: %s\n", strerror(errno));
+            exit(-1);
+        }
+
+        if(pid == 0)
+        {
+            me = r;
+            children.clear();
+            break;
+        }
+        children.push_back(pid);
+    }
+
+    rank = me;
+    this->ranks = ranks;
+    first = (population.size() * me) / ranks;
+    last = (population.size() * (me + 1)) / ranks;
+}
+
+bool SharedBodies::Failed()
+{
+    int status;
+
+    if(rank != 0)
+    {
+        return header->failed || (getppid() != header->parent);
+    }
+
+    // rank 0 looks out for the others
+    FOR_EACH(it, children)
+    {
+        if((*it > 0) && (waitpid(*it, &status, WNOHANG) == *it))
+        {
+            *it = 0; // reaped
+            if(!(WIFEXITED(status) && (WEXITSTATUS(status) == 0)))
+            {
+                fprintf(stderr, "[Uni] process %u died.\n", (unsigned int)(it - children.begin()) + 1);
+                header->failed = 1;
+            }
+        }
+    }
+    return header->failed;
+}
+
+void SharedBodies::Barrier()
+{
+    // the last one in starts the next generation
+    const int generation = header->generation;
+    if(__sync_add_and_fetch(&header->arrived, 1) == (int)ranks)
+    {
+        header->arrived = 0;
+        __sync_add_and_fetch(&header->generation, 1);
+        return;
+    }
+
+    unsigned int spins = 0;
+    while(header->generation == generation)
+    {
+        if(++spins < 100)
+        {
+            continue;
+        }
+
+        spins = 0;
+        if(Failed())
+        {
+            fprintf(stderr, "[Uni] process %u: another process died, stopping.\n", rank);
+            exit(-1);
+        }
+        sched_yield();
+    }
+    __sync_synchronize();
+}
+
+void SharedBodies::Wait()
+{
+    int status;
+
+    FOR_EACH(it, children)
+    {
+        if((*it > 0) && (waitpid(*it, &status, 0) == *it) && !(WIFEXITED(status) && (WEXITSTATUS(status) == 0)))
+        {
+            fprintf(stderr, "[Uni] process %u exited abnormally.\n", (unsigned int)(it - children.begin()) + 1);
+        }
+    }
+    children.clear();
+}
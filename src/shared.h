@@ -0,0 +1,77 @@
+/****
+         shared.h
+         Several processes stepping one population in shared memory.
+
+         part of universe (https://github.com/antsam/universe)
+****/
+
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <vector>
+#include <sys/types.h>
+#include "universe.h"
+
+namespace Uni
+{
+    /** The bodies of every robot in a POSIX shared memory segment, mapped
+        by several processes, with room after them for a spatial index.
+        Each process steps a slice of the slots and senses straight from
+        everyone's positions, so nothing is copied between them. Processes
+        meet at a barrier in the segment.
+
+        If any process dies the others stop at the next barrier, instead
+        of waiting for it forever. */
+    class SharedBodies
+    {
+    public:
+        unsigned int rank;    // this process, 0 to ranks - 1
+        unsigned int ranks;    // number of processes
+        std::size_t first, last;    // slots stepped here, [first, last)
+
+        SharedBodies();
+        ~SharedBodies();
+
+        /** Is the population shared at all? */
+        bool Active() const { return ranks > 1; }
+
+        /** Move the bodies into a new segment with index_bytes more for
+            the index, load the population into them and fork ranks - 1
+            more processes. Returns in every process. */
+        void Split(unsigned int ranks, Bodies& bodies, const std::vector<Robot>& population, std::size_t index_bytes);
+
+        /** The memory for the index, on a cache line. */
+        void* Index() const { return index; }
+
+        /** Wait until every process has got here. */
+        void Barrier();
+
+        /** Wait for the other processes to exit. Only rank 0 has any. */
+        void Wait();
+
+    private:
+        SharedBodies(const SharedBodies& other);
+        SharedBodies& operator=(const SharedBodies& other);
+
+        // the start of the segment, padded to a cache line
+        struct Header
+        {
+            volatile int arrived;    // processes at the barrier
+            volatile int generation;    // barriers passed
+            volatile int failed;    // a process died
+            pid_t parent;    // rank 0
+        };
+
+        // has something gone wrong in another process?
+        bool Failed();
+
+        Header* header;
+        void* index;
+        std::size_t bytes;
+        std::vector<pid_t> children;
+    };
+
+    extern SharedBodies shared;
+}; // namespace Uni
+
+#endif // SHARED_H
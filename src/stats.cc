@@ -0,0 +1,165 @@
+/****
+         stats.cc
+         Timing of the phases of a simulation step.
+
+         part of universe (https://github.com/antsam/universe)
+****/
+
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include "stats.h"
+
+using namespace Uni;
+
+uint64_t Uni::NowNs()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return ((uint64_t)t.tv_sec * 1000000000ULL) + t.tv_nsec;
+}
+
+Histogram::Histogram()
+    : count(0),
+        total(0),
+        min(0),
+        max(0)
+{
+    memset(buckets, 0, sizeof(buckets));
+}
+
+// durations below 2^sub_bits have a bucket each. Above that, the bucket is
+// the position of the leading bit and the sub_bits bits after it.
+unsigned int Histogram::Bucket(uint64_t ns)
+{
+    if(ns < (1ULL << sub_bits))
+    {
+        return ns;
+    }
+
+    unsigned int top = 63 - __builtin_clzll(ns);
+    unsigned int mantissa = (ns >> (top - sub_bits)) & ((1 << sub_bits) - 1);
+    return ((top - sub_bits + 1) << sub_bits) + mantissa;
+}
+
+uint64_t Histogram::UpperBound(unsigned int bucket)
+{
+    if(bucket < (1U << sub_bits))
+    {
+        return bucket;
+    }
+
+    unsigned int top = (bucket >> sub_bits) + sub_bits - 1;
+    uint64_t mantissa = bucket & ((1 << sub_bits) - 1);
+    uint64_t width = 1ULL << (top - sub_bits);
+    return (((1ULL << sub_bits) + mantissa) * width) + (width - 1);
+}
+
+void Histogram::Add(uint64_t ns)
+{
+    ++buckets[Bucket(ns)];
+    if((count == 0) || (ns < min))
+        min = ns;
+    if(ns > max)
+        max = ns;
+    ++count;
+    total += ns;
+}
+
+uint64_t Histogram::Percentile(double p) const
+{
+    if(count == 0)
+    {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)ceil((p / 100.0) * count);
+    uint64_t seen = 0;
+    unsigned int b = 0;
+
+    if(rank < 1)
+        rank = 1;
+
+    for(; b < bucket_count; ++b)
+    {
+        seen += buckets[b];
+        if(seen >= rank)
+        {
+            break;
+        }
+    }
+
+    uint64_t bound = UpperBound(b);
+    return (bound < max) ? bound : max;
+}
+
+StepStats::StepStats()
+    : robots_processed(0),
+        last(0),
+        step_start(0)
+{
+}
+
+const char* StepStats::PhaseName(Phase phase)
+{
+    static const char* names[PHASE_COUNT] = { "sort", "pose", "exchange", "index", "sense", "flush", "callbacks", "log" };
+    return names[phase];
+}
+
+// robots handled per second of time spent in a phase
+static double RobotsPerSecond(uint64_t robots, uint64_t ns)
+{
+    return (ns > 0) ? (robots / (ns / 1e9)) : 0;
+}
+
+void StepStats::Print(FILE* out) const
+{
+    const double all = (steps.Total() > 0) ? (double)steps.Total() : 1.0;
+    int p = 0;
+
+    fprintf(out, "[Uni] %lu steps, %lu robot updates in %.3f s (%.0f robots/s)\n",
+            (long unsigned)steps.Count(), (long unsigned)robots_processed, steps.Total() / 1e9,
+            RobotsPerSecond(robots_processed, steps.Total()));
+    fprintf(out, "[Uni] %-10s %10s %6s %10s %10s %10s %10s %14s\n",
+            "phase", "total ms", "share", "p50 us", "p90 us", "p99 us", "max us", "robots/s");
+
+    for(; p < PHASE_COUNT; ++p)
+    {
+        const Histogram& h = phases[p];
+
+        fprintf(out, "[Uni] %-10s %10.1f %5.1f%% %10.1f %10.1f %10.1f %10.1f %14.0f\n",
+                PhaseName((Phase)p), h.Total() / 1e6, 100.0 * h.Total() / all,
+                h.Percentile(50) / 1e3, h.Percentile(90) / 1e3, h.Percentile(99) / 1e3, h.Max() / 1e3,
+                RobotsPerSecond(robots_processed, h.Total()));
+    }
+}
+
+// one histogram as a JSON object, times in nanoseconds
+static void PrintHistogramJson(FILE* out, const Histogram& h, uint64_t robots)
+{
+    fprintf(out, "{\"count\": %lu, \"total_ns\": %lu, \"mean_ns\": %.1f, \"min_ns\": %lu, "
+            "\"p50_ns\": %lu, \"p90_ns\": %lu, \"p99_ns\": %lu, \"max_ns\": %lu, \"robots_per_second\": %.1f}",
+            (long unsigned)h.Count(), (long unsigned)h.Total(),
+            h.Count() ? ((double)h.Total() / h.Count()) : 0.0, (long unsigned)h.Min(),
+            (long unsigned)h.Percentile(50), (long unsigned)h.Percentile(90), (long unsigned)h.Percentile(99),
+            (long unsigned)h.Max(), RobotsPerSecond(robots, h.Total()));
+}
+
+void StepStats::PrintJson(FILE* out) const
+{
+    int p = 0;
+
+    fprintf(out, "{\n  \"steps\": %lu,\n  \"robots_processed\": %lu,\n  \"step\": ",
+            (long unsigned)steps.Count(), (long unsigned)robots_processed);
+    PrintHistogramJson(out, steps, robots_processed);
+    fprintf(out, ",\n  \"phases\": {\n");
+
+    for(; p < PHASE_COUNT; ++p)
+    {
+        fprintf(out, "    \"%s\": ", PhaseName((Phase)p));
+        PrintHistogramJson(out, phases[p], robots_processed);
+        fprintf(out, "%s\n", ((p + 1) < PHASE_COUNT) ? "," : "");
+    }
+
+    fprintf(out, "  }\n}\n");
+}
@@ -0,0 +1,103 @@
+/****
+         stats.h
+         Timing of the phases of a simulation step.
+
+         part of universe (https://github.com/antsam/universe)
+****/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <cstdio>
+#include <stdint.h>
+
+namespace Uni
+{
+    /** Nanoseconds from a monotonic clock. */
+    uint64_t NowNs();
+
+    /** Durations in nanoseconds, counted in buckets that grow with the
+        duration: 8 per power of two, so a percentile is within 12.5%
+        of the true value. Adding one is a few instructions. */
+    class Histogram
+    {
+    public:
+        Histogram();
+
+        void Add(uint64_t ns);
+
+        uint64_t Count() const { return count; }
+        uint64_t Total() const { return total; }
+        uint64_t Min() const { return count ? min : 0; }
+        uint64_t Max() const { return max; }
+
+        /** Upper bound of the bucket holding the p-th percentile (0 to 100),
+            clamped to the largest duration seen. */
+        uint64_t Percentile(double p) const;
+
+    private:
+        static const unsigned int sub_bits = 3;
+        static const unsigned int bucket_count = (64 - sub_bits + 1) << sub_bits;
+
+        static unsigned int Bucket(uint64_t ns);
+        static uint64_t UpperBound(unsigned int bucket);
+
+        uint64_t buckets[bucket_count];
+        uint64_t count, total, min, max;
+    };
+
+    /** The parts of UpdateAll() that are timed. */
+    enum Phase
+    {
+        PHASE_SORT,
+        PHASE_POSE,
+        PHASE_EXCHANGE,
+        PHASE_INDEX,
+        PHASE_SENSE,
+        PHASE_FLUSH,
+        PHASE_CALLBACKS,
+        PHASE_LOG,
+        PHASE_COUNT
+    };
+
+    /** Per-phase histograms of the time spent in every step. */
+    class StepStats
+    {
+    public:
+        StepStats();
+
+        /** Start timing a step. */
+        void Begin() { last = NowNs(); step_start = last; }
+
+        /** The phase that started at the last mark has ended. */
+        void Mark(Phase phase)
+        {
+            uint64_t now = NowNs();
+            phases[phase].Add(now - last);
+            last = now;
+        }
+
+        /** The step has ended, having updated this many robots. */
+        void End(uint64_t robots)
+        {
+            steps.Add(NowNs() - step_start);
+            robots_processed += robots;
+        }
+
+        /** Human readable summary. */
+        void Print(FILE* out) const;
+
+        /** The same as JSON. */
+        void PrintJson(FILE* out) const;
+
+        static const char* PhaseName(Phase phase);
+
+    private:
+        Histogram phases[PHASE_COUNT];
+        Histogram steps;
+        uint64_t robots_processed;
+        uint64_t last, step_start;
+    };
+}; // namespace Uni
+
+#endif // STATS_H
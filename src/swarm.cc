@@ -0,0 +1,104 @@
+/****
+         swarm.cc
+         The demo controller: every robot turns away from the closest robot
+         it sees.
+
+         part of universe (https://github.com/antsam/universe)
+****/
+
+#include "swarm.h"
+
+bool invert = false;
+
+// The pixel that sees the closest robot, or -1 if none of them see one.
+// PIXELS is the pixel count if it is known at compile time, or 0.
+template<unsigned int PIXELS>
+static int Closest(const Uni::Robot::Pixel* pixels, unsigned int pixel_count)
+{
+    if(PIXELS > 0)
+        pixel_count = PIXELS;
+
+    int closest = -1;
+    double dist = Uni::Robot::range; // max sensor range
+
+    unsigned int p = 0;
+    for(; p < pixel_count; ++p)
+    {
+        if(pixels[p].range < dist)
+        {
+            closest = (int)p;
+            dist = pixels[p].range;
+        }
+    }
+    return closest;
+}
+
+// Closest() unrolled for the common sensor sizes
+static int FindClosest(const Uni::Robot::Pixel* pixels, unsigned int pixel_count)
+{
+    switch(pixel_count)
+    {
+        case 8: return Closest<8>(pixels, pixel_count);
+        case 16: return Closest<16>(pixels, pixel_count);
+        case 32: return Closest<32>(pixels, pixel_count);
+        case 64: return Closest<64>(pixels, pixel_count);
+        default: return Closest<0>(pixels, pixel_count);
+    }
+}
+
+// Examine the robot's pixels vector and set the speed sensibly.
+void Controller(Uni::Robot& r, void* dummy_data)
+{
+    r.speed[0] = 0.005;     // constant forward speed
+    r.speed[1] = 0.0;         // no turning. we may change this below
+
+    // steer away from the closest roboot
+    const size_t pixel_count = r.pixels.size();
+    int closest = FindClosest(r.pixels.begin(), pixel_count);
+
+    if(closest < 0) // nothing nearby: cruise
+        return;
+
+    if(closest < (int)pixel_count / 2)
+        r.speed[1] = 0.04; // rotate right
+    else
+        r.speed[1] = -0.04; // rotate left
+
+    if(invert)
+        r.speed[1] *= -1.0; // invert turn direction
+}
+
+// Steer a whole block of robots, with PIXELS as in Closest().
+template<unsigned int PIXELS>
+static void SteerBlock(const Uni::RobotBlock& block)
+{
+    const unsigned int pixel_count = (PIXELS > 0) ? PIXELS : block.pixel_count;
+    const double turn = invert ? -0.04 : 0.04;
+    const Uni::Robot::Pixel* pixels = block.pixels;
+
+    size_t i = 0;
+    for(; i < block.count; ++i, pixels += pixel_count)
+    {
+        // steer away from the closest robot
+        int closest = Closest<PIXELS>(pixels, pixel_count);
+
+        block.v[i] = 0.005;
+        if(closest < 0)
+            block.w[i] = 0.0; // nothing nearby: cruise
+        else
+            block.w[i] = (closest < (int)pixel_count / 2) ? turn : -turn;
+    }
+}
+
+// The same controller for a whole block of robots at once.
+void BatchController(const Uni::RobotBlock& block, void* dummy_data)
+{
+    switch(block.pixel_count)
+    {
+        case 8: SteerBlock<8>(block); break;
+        case 16: SteerBlock<16>(block); break;
+        case 32: SteerBlock<32>(block); break;
+        case 64: SteerBlock<64>(block); break;
+        default: SteerBlock<0>(block); break;
+    }
+}
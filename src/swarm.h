@@ -0,0 +1,23 @@
+/****
+         swarm.h
+         The demo controller: every robot turns away from the closest robot
+         it sees.
+
+         part of universe (https://github.com/antsam/universe)
+****/
+
+#ifndef SWARM_H
+#define SWARM_H
+
+#include "universe.h"
+
+// turn towards the closest robot instead
+extern bool invert;
+
+// the per-robot callback
+void Controller(Uni::Robot& r, void* dummy_data);
+
+// the batch callback, which sets the speeds Controller() would
+void BatchController(const Uni::RobotBlock& block, void* dummy_data);
+
+#endif // SWARM_H
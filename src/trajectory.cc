@@ -0,0 +1,465 @@
+/****
+         trajectory.cc
+         Logging the pose of every robot, step by step, to a compact file.
+
+         part of universe (https://github.com/antsam/universe)
+****/
+
+#include <cerrno>
+#include "trajectory.h"
+
+using namespace Uni;
+
+static const char magic[8] = { 'U', 'N', 'I', 'T', 'R', 'A', 'J', '1' };
+static const char exact_magic[8] = { 'U', 'N', 'I', 'T', 'R', 'A', 'J', 'X' };
+static const std::size_t file_header_bytes = 8 + 8 + 8; // magic, robots, worldsize
+static const std::size_t frame_header_bytes = 8 + 1 + 4 + 4; // update, flags, encoded and stored sizes
+static const uint64_t key_period = 64; // frames from one key frame to the next
+
+// frame flags
+static const uint8_t KEY_FRAME = 1;
+static const uint8_t COMPRESSED = 2;
+
+static inline void PutVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+    while(value >= 0x80)
+    {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+// read a varint at in[pos], or return false if it runs off the end
+static inline bool GetVarint(const uint8_t* in, std::size_t n, std::size_t& pos, uint64_t& value)
+{
+    unsigned int shift = 0;
+
+    value = 0;
+    while((pos < n) && (shift < 64))
+    {
+        uint8_t byte = in[pos++];
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if(byte < 0x80)
+        {
+            return true;
+        }
+        shift += 7;
+    }
+    return false;
+}
+
+// a run of literal bytes, then a match (length - 4, distance back) unless
+// the input ends with the literals
+void Uni::LzCompress(const uint8_t* in, std::size_t n, std::vector<uint8_t>& out)
+{
+    const unsigned int hash_bits = 14;
+    const uint32_t none = 0xffffffff;
+    std::vector<uint32_t> table(1 << hash_bits, none);
+    std::size_t anchor = 0, i = 0, length;
+    uint32_t word, candidate;
+
+    while((i + 4) <= n)
+    {
+        memcpy(&word, in + i, 4);
+        uint32_t h = (word * 2654435761U) >> (32 - hash_bits);
+        candidate = table[h];
+        table[h] = i;
+
+        if((candidate == none) || ((i - candidate) > 65535) || (memcmp(in + candidate, in + i, 4) != 0))
+        {
+            ++i;
+            continue;
+        }
+
+        for(length = 4; ((i + length) < n) && (in[candidate + length] == in[i + length]); ++length)
+        {
+        }
+
+        PutVarint(out, i - anchor);
+        out.insert(out.end(), in + anchor, in + i);
+        PutVarint(out, length - 4);
+        PutVarint(out, i - candidate);
+
+        i += length;
+        anchor = i;
+    }
+
+    PutVarint(out, n - anchor);
+    out.insert(out.end(), in + anchor, in + n);
+}
+
+bool Uni::LzDecompress(const uint8_t* in, std::size_t n, std::vector<uint8_t>& out)
+{
+    const std::size_t start = out.size();
+    std::size_t pos = 0;
+    uint64_t literals, length, distance;
+
+    while(true)
+    {
+        if(!GetVarint(in, n, pos, literals) || (literals > (n - pos)))
+        {
+            return false;
+        }
+        out.insert(out.end(), in + pos, in + pos + literals);
+        pos += literals;
+
+        if(pos == n)
+        {
+            return true;
+        }
+
+        if(!GetVarint(in, n, pos, length) || !GetVarint(in, n, pos, distance)
+           || (distance == 0) || (distance > (out.size() - start)))
+        {
+            return false;
+        }
+
+        // the match may overlap what it copies, so go a byte at a time
+        std::size_t from = out.size() - distance;
+        for(length += 4; length > 0; --length, ++from)
+        {
+            out.push_back(out[from]);
+        }
+    }
+}
+
+TrajectoryWriter::TrajectoryWriter()
+    : out(NULL),
+        robots(0),
+        worldsize(1),
+        compress(false),
+        exact(false),
+        pending(false),
+        closing(false),
+        back_update(0),
+        frames(0),
+        stalls(0)
+{
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&changed, NULL);
+}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+    Close();
+    pthread_cond_destroy(&changed);
+    pthread_mutex_destroy(&lock);
+}
+
+bool TrajectoryWriter::Open(const char* path, std::size_t robots, double worldsize, bool compress, bool exact)
+{
+    this->robots = robots;
+    this->worldsize = worldsize;
+    this->compress = compress;
+    this->exact = exact;
+
+    out = fopen(path, "wb");
+    if(out == NULL)
+    {
+        fprintf(stderr, "[Uni] Failed to write %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+
+    uint64_t count = robots;
+    fwrite(exact ? exact_magic : magic, sizeof(magic), 1, out);
+    fwrite(&count, sizeof(count), 1, out);
+    fwrite(&worldsize, sizeof(worldsize), 1, out);
+
+    front.resize(exact ? 0 : (3 * robots));
+    back.resize(exact ? 0 : (3 * robots));
+    previous.assign(exact ? 0 : (3 * robots), 0);
+    exact_front.resize(exact ? (3 * robots) : 0);
+    exact_back.resize(exact ? (3 * robots) : 0);
+    frames = 0;
+    stalls = 0;
+    pending = false;
+    closing = false;
+
+    if(pthread_create(&thread, NULL, Main, this) != 0)
+    {
+        fprintf(stderr, "[Uni] Failed to start the trajectory writer.\n");
+        fclose(out);
+        out = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+void TrajectoryWriter::Record(const Bodies& bodies, uint64_t update)
+{
+    const double to_grid = 65536.0 / worldsize;
+    const double to_angle = 65536.0 / (2.0 * M_PI);
+    uint16_t* xs = &front[0];
+    uint16_t* ys = xs + robots;
+    uint16_t* as = ys + robots;
+    std::size_t i = 0, k;
+
+    // in population order, so frames line up however the slots are sorted
+    for(; exact && (i < robots); ++i)
+    {
+        k = bodies.slot[i];
+        exact_front[i] = bodies.x[k];
+        exact_front[robots + i] = bodies.y[k];
+        exact_front[(2 * robots) + i] = bodies.a[k];
+    }
+    for(; !exact && (i < robots); ++i)
+    {
+        k = bodies.slot[i];
+        xs[i] = (uint16_t)(int64_t)floor(bodies.x[k] * to_grid);
+        ys[i] = (uint16_t)(int64_t)floor(bodies.y[k] * to_grid);
+        as[i] = (uint16_t)(int64_t)floor((bodies.a[k] + M_PI) * to_angle);
+    }
+
+    pthread_mutex_lock(&lock);
+    if(pending)
+    {
+        ++stalls;
+        while(pending)
+            pthread_cond_wait(&changed, &lock);
+    }
+    front.swap(back);
+    exact_front.swap(exact_back);
+    back_update = update;
+    pending = true;
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&lock);
+}
+
+void TrajectoryWriter::Close()
+{
+    if(out == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+    closing = true;
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&lock);
+
+    pthread_join(thread, NULL);
+    fclose(out);
+    out = NULL;
+}
+
+void* TrajectoryWriter::Main(void* arg)
+{
+    TrajectoryWriter& writer = *static_cast<TrajectoryWriter*>(arg);
+
+    pthread_mutex_lock(&writer.lock);
+    while(true)
+    {
+        while(!writer.pending && !writer.closing)
+            pthread_cond_wait(&writer.changed, &writer.lock);
+
+        if(!writer.pending)
+        {
+            break; // closing, with nothing left to write
+        }
+
+        // Record() leaves the back buffer alone while it is pending
+        pthread_mutex_unlock(&writer.lock);
+        if(writer.exact)
+            writer.WriteExact(writer.exact_back, writer.back_update);
+        else
+            writer.Write(writer.back, writer.back_update);
+        pthread_mutex_lock(&writer.lock);
+
+        writer.pending = false;
+        pthread_cond_broadcast(&writer.changed);
+    }
+    pthread_mutex_unlock(&writer.lock);
+
+    return NULL;
+}
+
+void TrajectoryWriter::Write(const std::vector<uint16_t>& poses, uint64_t update)
+{
+    const bool key = (frames % key_period) == 0;
+    const std::size_t n = poses.size();
+    std::size_t i = 0;
+
+    encoded.clear();
+    for(; i < n; ++i)
+    {
+        // the difference wraps around, like the world
+        int16_t delta = (int16_t)(uint16_t)(poses[i] - (key ? 0 : previous[i]));
+        PutVarint(encoded, (uint16_t)(((uint16_t)delta << 1) ^ (uint16_t)(delta >> 15)));
+    }
+    previous = poses;
+
+    WriteFrame(key ? KEY_FRAME : 0, update);
+}
+
+// every exact frame stands alone
+void TrajectoryWriter::WriteExact(const std::vector<double>& poses, uint64_t update)
+{
+    encoded.resize(poses.size() * sizeof(double));
+    if(!poses.empty())
+    {
+        memcpy(&encoded[0], &poses[0], encoded.size());
+    }
+
+    WriteFrame(KEY_FRAME, update);
+}
+
+// write out the frame in encoded, compressing it if that makes it smaller
+void TrajectoryWriter::WriteFrame(uint8_t flags, uint64_t update)
+{
+    const std::vector<uint8_t>* stored = &encoded;
+    if(compress)
+    {
+        compressed.clear();
+        LzCompress(encoded.empty() ? NULL : &encoded[0], encoded.size(), compressed);
+        if(compressed.size() < encoded.size())
+        {
+            flags |= COMPRESSED;
+            stored = &compressed;
+        }
+    }
+
+    uint8_t header[frame_header_bytes];
+    uint32_t encoded_bytes = encoded.size(), stored_bytes = stored->size();
+    memcpy(header, &update, 8);
+    header[8] = flags;
+    memcpy(header + 9, &encoded_bytes, 4);
+    memcpy(header + 13, &stored_bytes, 4);
+
+    fwrite(header, sizeof(header), 1, out);
+    if(!stored->empty())
+    {
+        fwrite(&(*stored)[0], stored->size(), 1, out);
+    }
+    ++frames;
+}
+
+TrajectoryReader::TrajectoryReader()
+    : in(NULL),
+        robots(0),
+        worldsize(1),
+        exact(false)
+{
+}
+
+TrajectoryReader::~TrajectoryReader()
+{
+    if(in != NULL)
+        fclose(in);
+}
+
+bool TrajectoryReader::Open(const char* path)
+{
+    char header[file_header_bytes];
+    uint64_t count;
+
+    in = fopen(path, "rb");
+    if(in == NULL)
+    {
+        fprintf(stderr, "[Uni] Failed to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    const bool whole = fread(header, sizeof(header), 1, in) == 1;
+    exact = whole && (memcmp(header, exact_magic, sizeof(magic)) == 0);
+    if(!whole || (!exact && (memcmp(header, magic, sizeof(magic)) != 0)))
+    {
+        fprintf(stderr, "[Uni] %s is not a trajectory.\n", path);
+        return false;
+    }
+
+    memcpy(&count, header + 8, 8);
+    memcpy(&worldsize, header + 16, 8);
+    robots = count;
+    poses.assign(3 * robots, 0);
+    return true;
+}
+
+bool TrajectoryReader::Next(uint64_t& update, std::vector<double>& x, std::vector<double>& y, std::vector<double>& a)
+{
+    uint8_t header[frame_header_bytes];
+    uint32_t encoded_bytes, stored_bytes;
+
+    if((in == NULL) || (fread(header, sizeof(header), 1, in) != 1))
+    {
+        return false;
+    }
+
+    memcpy(&update, header, 8);
+    const uint8_t flags = header[8];
+    memcpy(&encoded_bytes, header + 9, 4);
+    memcpy(&stored_bytes, header + 13, 4);
+
+    stored.resize(stored_bytes);
+    if((stored_bytes > 0) && (fread(&stored[0], stored_bytes, 1, in) != 1))
+    {
+        return false;
+    }
+
+    const std::vector<uint8_t>* source = &stored;
+    if(flags & COMPRESSED)
+    {
+        encoded.clear();
+        if(!LzDecompress(stored.empty() ? NULL : &stored[0], stored.size(), encoded))
+        {
+            return false;
+        }
+        source = &encoded;
+    }
+
+    if(source->size() != encoded_bytes)
+    {
+        return false;
+    }
+
+    x.resize(robots);
+    y.resize(robots);
+    a.resize(robots);
+
+    if(exact)
+    {
+        if(source->size() != (3 * robots * sizeof(double)))
+        {
+            return false;
+        }
+
+        const std::size_t plane = robots * sizeof(double);
+        if(robots > 0)
+        {
+            memcpy(&x[0], &(*source)[0], plane);
+            memcpy(&y[0], &(*source)[plane], plane);
+            memcpy(&a[0], &(*source)[2 * plane], plane);
+        }
+        return true;
+    }
+
+    const uint8_t* bytes = source->empty() ? NULL : &(*source)[0];
+    const std::size_t n = poses.size();
+    std::size_t pos = 0, i = 0;
+    uint64_t zigzag;
+
+    for(; i < n; ++i)
+    {
+        if(!GetVarint(bytes, source->size(), pos, zigzag))
+        {
+            return false;
+        }
+
+        uint16_t delta = (uint16_t)((zigzag >> 1) ^ (0 - (zigzag & 1)));
+        poses[i] = (flags & KEY_FRAME) ? delta : (uint16_t)(poses[i] + delta);
+    }
+
+    // the middle of each quantization step
+    const double from_grid = worldsize / 65536.0;
+    const double from_angle = (2.0 * M_PI) / 65536.0;
+    for(i = 0; i < robots; ++i)
+    {
+        x[i] = (poses[i] + 0.5) * from_grid;
+        y[i] = (poses[robots + i] + 0.5) * from_grid;
+        a[i] = ((poses[(2 * robots) + i] + 0.5) * from_angle) - M_PI;
+    }
+
+    return true;
+}
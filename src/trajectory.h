@@ -0,0 +1,132 @@
+/****
+         trajectory.h
+         Logging the pose of every robot, step by step, to a compact file.
+
+         part of universe (https://github.com/antsam/universe)
+****/
+
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <cstdio>
+#include <pthread.h>
+#include <stdint.h>
+#include <vector>
+#include "universe.h"
+
+namespace Uni
+{
+    /** A trajectory file is a header (the number of robots and the world
+        size) and then one frame per logged step. A frame holds x, y and
+        heading of every robot in population order, each quantized to 16
+        bits (worldsize / 65536 and 2 pi / 65536). Each value is stored as
+        the difference from the frame before, wrapping around like the
+        world does, as a zigzag varint. That is one or two bytes for a
+        robot that moved less than 1/500th of the world. Every 64th frame
+        is a key frame that stands alone. A frame may also be compressed
+        with LzCompress().
+
+        An exact trajectory has a magic of its own and stores every pose
+        as three doubles instead, 24 bytes per robot in every frame. It is
+        for comparing runs, such as the float build against the double
+        one, closer than the 16-bit steps. */
+
+    /** Compress n bytes of in and append them to out. Matches of 4 bytes
+        or more within the last 64KB become references back to them. */
+    void LzCompress(const uint8_t* in, std::size_t n, std::vector<uint8_t>& out);
+
+    /** Undo LzCompress(), appending to out. Returns false if in is
+        damaged. */
+    bool LzDecompress(const uint8_t* in, std::size_t n, std::vector<uint8_t>& out);
+
+    /** Writes frames from a thread of its own. Record() copies the poses
+        into one of two buffers and returns while the other one is
+        encoded and written. It only waits if the writer has fallen a
+        whole frame behind. */
+    class TrajectoryWriter
+    {
+    public:
+        TrajectoryWriter();
+        ~TrajectoryWriter();
+
+        /** Start a file at path for robots robots, exact or quantized.
+            Returns false, having said why, if it can't be written. */
+        bool Open(const char* path, std::size_t robots, double worldsize, bool compress, bool exact);
+
+        bool IsOpen() const { return out != NULL; }
+
+        /** Log the poses in bodies as they are after step update. */
+        void Record(const Bodies& bodies, uint64_t update);
+
+        /** Write the last frame and close the file. */
+        void Close();
+
+        /** Frames written, and the times Record() had to wait. */
+        uint64_t Frames() const { return frames; }
+        uint64_t Stalls() const { return stalls; }
+
+    private:
+        TrajectoryWriter(const TrajectoryWriter& other);
+        TrajectoryWriter& operator=(const TrajectoryWriter& other);
+
+        static void* Main(void* arg);
+        void Write(const std::vector<uint16_t>& poses, uint64_t update);
+        void WriteExact(const std::vector<double>& poses, uint64_t update);
+        void WriteFrame(uint8_t flags, uint64_t update);
+
+        FILE* out;
+        std::size_t robots;
+        double worldsize;
+        bool compress;
+        bool exact;
+
+        pthread_t thread;
+        pthread_mutex_t lock;
+        pthread_cond_t changed;
+        bool pending;    // the back buffer holds a frame to write
+        bool closing;
+
+        std::vector<uint16_t> front, back;    // x, y and heading planes
+        std::vector<double> exact_front, exact_back;    // the same, for an exact trajectory
+        uint64_t back_update;
+        std::vector<uint16_t> previous;    // the last frame written
+        std::vector<uint8_t> encoded, compressed;
+        uint64_t frames, stalls;
+    };
+
+    /** Reads frames back, in order. */
+    class TrajectoryReader
+    {
+    public:
+        TrajectoryReader();
+        ~TrajectoryReader();
+
+        /** Returns false, having said why, if path isn't a trajectory. */
+        bool Open(const char* path);
+
+        std::size_t Robots() const { return robots; }
+        double WorldSize() const { return worldsize; }
+
+        /** The step between the positions the file can hold, or 0 for an
+            exact trajectory. */
+        double Quantum() const { return exact ? 0 : (worldsize / 65536.0); }
+
+        /** Read the next frame into x, y and a, indexed like the
+            population. Returns false at the end of the file or if it is
+            damaged. */
+        bool Next(uint64_t& update, std::vector<double>& x, std::vector<double>& y, std::vector<double>& a);
+
+    private:
+        TrajectoryReader(const TrajectoryReader& other);
+        TrajectoryReader& operator=(const TrajectoryReader& other);
+
+        FILE* in;
+        std::size_t robots;
+        double worldsize;
+        bool exact;
+        std::vector<uint16_t> poses;
+        std::vector<uint8_t> stored, encoded;
+    };
+}; // namespace Uni
+
+#endif // TRAJECTORY_H
@@ -6,128 +6,587 @@
          modified by Anton Samson (https://github.com/antsam/universe)
 ****/
 
+#include <algorithm>
 #include <cassert>
 #include <unistd.h>
 #include <iostream>
 #include <sys/time.h>
 #include "universe.h"
 #include "QuadTree.h"
+#include "SpatialGrid.h"
+#include "ThreadPool.h"
+#include "checkpoint.h"
+#include "domain.h"
+#include "shared.h"
+#include "kernels.h"
+#include "stats.h"
+#include "trajectory.h"
 
 const int period = 10;  // for timing FPS
+const std::size_t sense_grain = 64; // robots claimed at a time by a sensing thread
+const std::size_t control_grain = 256; // robots handed to the batch callback at a time
 
 Anton::QuadTree *tree;
-std::vector<Uni::Robot *> quadrant, quadrant_overflow;
+bool tree_filled(false); // the tree holds every robot between steps
+Anton::SpatialGrid *grid;
+Anton::ThreadPool *workers;
+Uni::Neighbours quadrant;
+std::vector<Uni::Neighbours> worker_quadrants; // one candidate buffer per thread
+std::vector<double> worker_longest; // longest step of each thread's robots
+std::vector<double> worker_slack; // most slack of each thread's neighbour lists
 
 using namespace Uni;
 
-const char* PROGNAME = "universe";
-
-#if GRAPHICS
-    #ifdef __APPLE__
-        #include <glut/glut.h>
-    #else
-        #include <GL/glut.h> // OS X users need <glut/glut.h> instead
-    #endif
-#endif
-
 namespace Uni
 {
     bool need_redraw(true);
-    double worldsize(1.0);
+    real worldsize(1.0);
     std::vector<Robot> population(100); // why are we defaulting to 100?
     uint64_t updates(0);
     uint64_t updates_max(0.0);
     bool paused(false);
     int winsize(600);
-    int displaylist(0);
     bool show_data(true);
     unsigned int sleep_msec(50);
     double lastseconds;
+    Bodies bodies;
+    Bodies next_bodies;    // the poses written by a step under -D
+    PixelArena pixel_arena;
+    bool use_grid(false);
+    unsigned int thread_count(1);
+    unsigned int sort_period(0);
+    bool incremental_tree(false);
+    double skin(0.0);
+    NeighbourLists neighbour_lists;
+    bool sector_binning(false);
+    SectorTable sectors;
+    const FrontEnd* frontend(NULL);
+    StepStats step_stats;
+    bool print_stats(true);
+    const char* stats_json(NULL);    // file to write the step statistics to
+    BatchCallback batch_callback(NULL);
+    void* batch_data(NULL);
+    bool per_robot(false);    // call each robot's callback even if there is a batch callback
+    std::vector<Robot::Pixel> block_pixels;    // the sensors of every slot, for the batch callback
+    bool double_buffered(false);
+    std::vector<Robot> snapshot;    // the population as sensed, for double-buffered callbacks to look at
+    Robot* seen(NULL);    // the robots that pixels point into
+    int teleported_any(0);
+    unsigned int rank_count(1);    // processes to split the world between
+    Domain domain;
+    std::size_t owned_count(0);    // robots at the front of the population stepped by this process
+    unsigned int shared_count(1);    // processes to step the robots in shared memory
+    SharedBodies shared;
+    std::size_t slice_first(0);    // first slot stepped by this process
+    const char* save_file(NULL);    // checkpoint to write
+    unsigned int save_period(0);    // steps between checkpoints
+    const char* load_file(NULL);    // checkpoint to start from
+    const char* trajectory_file(NULL);    // where to log every robot's pose
+    unsigned int trajectory_stride(1);    // steps between logged poses
+    bool trajectory_lz(false);    // compress the logged poses
+    bool trajectory_exact(false);    // log the poses in full
+    TrajectoryWriter trajectory;
+    uint64_t random_seed(0);
 
     // Robot static members
     unsigned int Robot::pixel_count(8);
-    double Robot::range(0.1);
-    double Robot::fov(dtor(270.0));
+    real Robot::range(0.1);
+    real Robot::fov(dtor(270.0));
 }
 
 char usage[] = "Universe understands these command line arguments:\n"
     "    -? : Prints this helpful message.\n"
+    "    -b : finds the pixel that sees a robot with precomputed sector boundaries instead of atan2().\n"
     "    -c <int> : sets the number of pixels in the robots' sensor.\n"
+    "    --seed <int> : seeds the random numbers of the robots (0 by default).\n"
     "    -d    Disables drawing the sensor field of view. Speeds things up a bit.\n"
+    "    --per-robot : calls every robot's own callback even if the controller steers them in batches.\n"
+    "    -D : runs every phase of an update on all threads. New poses are written to a second copy of the robots and callbacks see the others as they were sensed, so the results are the same for any number of threads.\n"
     "    -f <float> : sets the sensor field of view angle in degrees.\n"
+    "    -g : uses a uniform grid instead of the quadtree to find nearby robots.\n"
+    "    -k : keeps the quadtree between updates and only moves robots that leave their node.\n"
+    "    -v <float> : caches the robots within range plus this distance of each robot, and only searches again when the cache may be out of date (0 never does).\n"
+    "    --ranks <int> : splits the world into this many strips, each stepped by a process of its own.\n"
+    "    --shm <int> : steps the robots with this many processes, sharing their state in shared memory.\n"
+    "    -m <int> : sorts the robots in memory by position every this many updates (0 never does).\n"
     "    -p <int> : set the size of the robot population.\n"
     "    -q : disables chatty status output (quiet mode).\n"
     "    -r <float> : sets the sensor field of view range.\n"
     "    -s <float> : sets the side length of the (square) world.\n"
+    "    -t <int> : sets the number of threads used to update the sensors.\n"
     "    -u <int> : sets the number of updates to run before quitting.\n"
     "    -w <int> : sets the initial size of the window, in pixels.\n"
-    "    -z <int> : sets the number of milliseconds to sleep between updates.\n";
+    "    -z <int> : sets the number of milliseconds to sleep between updates.\n"
+    "    --stats-json <file> : writes the time spent in each phase of the updates to a file as JSON.\n"
+    "    --save <file> : writes the state of every robot to a file at the end of the run.\n"
+    "    --save-period <int> : also writes it every this many updates.\n"
+    "    --load <file> : starts from the state in a file written by --save, which also sets the population size and the world size.\n"
+    "    --trajectory <file> : logs the pose of every robot to a file, from a thread of its own.\n"
+    "    --trajectory-stride <int> : logs every this many updates.\n"
+    "    --trajectory-lz : compresses the logged poses.\n"
+    "    --trajectory-exact : logs the poses in full, as doubles, for comparing runs.\n";
+
+// long options, with values past the range of the short ones
+static const struct option long_options[] = {
+    { "stats-json", required_argument, NULL, 256 },
+    { "ranks", required_argument, NULL, 257 },
+    { "shm", required_argument, NULL, 258 },
+    { "save", required_argument, NULL, 259 },
+    { "save-period", required_argument, NULL, 260 },
+    { "load", required_argument, NULL, 261 },
+    { "trajectory", required_argument, NULL, 262 },
+    { "trajectory-stride", required_argument, NULL, 263 },
+    { "trajectory-lz", no_argument, NULL, 264 },
+    { "seed", required_argument, NULL, 265 },
+    { "per-robot", no_argument, NULL, 266 },
+    { "trajectory-exact", no_argument, NULL, 267 },
+    { NULL, 0, NULL, 0 }
+};
+
+// summary of the step timings, on stderr and optionally as JSON. Every
+// rank reports its own, to a JSON file of its own.
+static void report_stats()
+{
+    if(print_stats)
+    {
+        fputc('\n', stderr);
+        if(domain.Active())
+        {
+            fprintf(stderr, "[Uni] rank %u of %u, %lu robots\n", domain.rank, domain.ranks, (long unsigned)owned_count);
+        }
+        else if(shared.Active())
+        {
+            fprintf(stderr, "[Uni] process %u of %u, slots %lu to %lu\n", shared.rank, shared.ranks,
+                    (long unsigned)shared.first, (long unsigned)shared.last);
+        }
+        step_stats.Print(stderr);
+    }
+
+    if(stats_json != NULL)
+    {
+        char name[4096];
+        if(domain.Active())
+            snprintf(name, sizeof(name), "%s.%u", stats_json, domain.rank);
+        else if(shared.Active())
+            snprintf(name, sizeof(name), "%s.%u", stats_json, shared.rank);
+        else
+            snprintf(name, sizeof(name), "%s", stats_json);
+
+        FILE* out = fopen(name, "w");
+        if(out == NULL)
+        {
+            fprintf(stderr, "[Uni] Failed to write %s.\n", name);
+            return;
+        }
+
+        step_stats.PrintJson(out);
+        fclose(out);
+    }
+}
+
+Robot::Robot()
+    : pose(),
+        speed(),
+        color(),
+        pixels(),
+        callback(NULL),
+        callback_data(NULL)
+{
+    // until C++ supports array literals in the initialization list, we're forced to do this
+    memset(pose, 0, sizeof(pose));
+    memset(speed, 0, sizeof(speed));
+    color[0] = 128;
+    color[1] = 0;
+    color[2] = 0;
+}
 
-#if GRAPHICS
-// GLUT callback functions ---------------------------------------------------
+const Robot* Robot::Pixel::Seen() const
+{
+    return (robot == NONE) ? NULL : &seen[robot];
+}
 
-// update the world - this is called whenever GLUT runs out of events
-// to process
-static void idle_func()
+PixelArena::PixelArena()
+    : block(NULL),
+        count(0),
+        capacity(0),
+        pixel_count(0)
 {
-    Uni::UpdateAll();
-    // possibly snooze to save CPU and slow things down
-    if(Uni::sleep_msec > 0)
-        usleep(Uni::sleep_msec * 1e3);
 }
 
-static void timer_func(int dummy)
+PixelArena::~PixelArena()
 {
-    glutPostRedisplay(); // force redraw
+    free(block);
+}
+
+void PixelArena::Allocate(std::size_t n)
+{
+    const std::size_t needed = n * Robot::pixel_count;
+    if(needed > capacity)
+    {
+        void* memory = NULL;
+        if(posix_memalign(&memory, 64, needed * sizeof(Robot::Pixel)) != 0)
+        {
+            fprintf(stderr, "[Uni] Failed to allocate sensors for %lu robots.\n", (long unsigned)n);
+            exit(-1);
+        }
+
+        free(block);
+        block = static_cast<Robot::Pixel*>(memory);
+        capacity = needed;
+    }
+
+    count = n;
+    pixel_count = Robot::pixel_count;
 }
 
-// draw the world - this is called whenever the window needs redrawn
-static void display_func()
+void PixelArena::Attach(std::vector<Robot>& robots, std::size_t begin, std::size_t end)
 {
-    if(Uni::need_redraw)
+    for(; begin < end; ++begin)
     {
-        Uni::need_redraw = false;
+        robots[begin].pixels = Robot::Pixels(block + (begin * pixel_count), pixel_count);
+    }
+}
 
-        glClear(GL_COLOR_BUFFER_BIT);
+void PixelArena::Clear(Robot::Pixel* pixels, std::size_t n)
+{
+    // the nearest float at or beyond the range, so nothing reads as closer
+    Robot::Pixel nothing;
+    nothing.range = (float)Robot::range;
+    if(nothing.range < Robot::range)
+        nothing.range = nextafterf(nothing.range, INFINITY);
+    nothing.robot = Robot::Pixel::NONE;
+
+    std::fill_n(pixels, n, nothing);
+}
+
+Bodies::Bodies()
+    : x(NULL),
+        y(NULL),
+        a(NULL),
+        v(NULL),
+        w(NULL),
+        id(NULL),
+        slot(NULL),
+        block(NULL),
+        placed(false),
+        count(0),
+        capacity(0)
+{
+}
+
+Bodies::~Bodies()
+{
+    if(!placed)
+        free(block);
+}
 
-        FOR_EACH(r, population)
+// round each array up to a whole number of cache lines so they all start
+// on one
+std::size_t Bodies::Stride(std::size_t n)
+{
+    const std::size_t per_line = 64 / sizeof(real);
+    return ((n + per_line - 1) / per_line) * per_line;
+}
+
+std::size_t Bodies::Bytes(std::size_t n)
+{
+    return (5 * Stride(n) * sizeof(real)) + (2 * Stride(n) * sizeof(uint32_t));
+}
+
+void Bodies::Arrange(void* memory, std::size_t stride)
+{
+    if(!placed)
+        free(block);
+
+    block = memory;
+    x = static_cast<real*>(block);
+    y = x + stride;
+    a = y + stride;
+    v = a + stride;
+    w = v + stride;
+    id = reinterpret_cast<uint32_t*>(w + stride);
+    slot = id + stride;
+    capacity = stride;
+}
+
+void Bodies::Allocate(std::size_t n)
+{
+    if(n > capacity)
+    {
+        void* memory = NULL;
+        if(posix_memalign(&memory, 64, Bytes(n)) != 0)
         {
-            r->Draw();
+            fprintf(stderr, "[Uni] Failed to allocate state for %lu robots.\n", (long unsigned)n);
+            exit(-1);
         }
 
-        glutSwapBuffers();
+        Arrange(memory, Stride(n));
+        placed = false;
+    }
+
+    count = n;
+}
+
+void Bodies::Place(std::size_t n, void* memory)
+{
+    Arrange(memory, Stride(n));
+    placed = true;
+    count = n;
+}
 
-        glFlush();
+void Bodies::Load(const std::vector<Robot>& robots)
+{
+    Allocate(robots.size());
+
+    std::size_t i = 0;
+    for(; i < count; ++i)
+    {
+        Load(i, robots[i]);
+        id[i] = i;
+        slot[i] = i;
     }
+}
+
+void Bodies::Load(std::size_t k, const Robot& r)
+{
+    x[k] = r.pose[0];
+    y[k] = r.pose[1];
+    a[k] = r.pose[2];
+    v[k] = r.speed[0];
+    w[k] = r.speed[1];
+}
 
-    // cause this run again in about 50 msec
-    glutTimerFunc(50, timer_func, 0);
+void Bodies::Store(std::size_t k, Robot& r) const
+{
+    r.pose[0] = x[k];
+    r.pose[1] = y[k];
+    r.pose[2] = a[k];
+    r.speed[0] = v[k];
+    r.speed[1] = w[k];
 }
 
-static void mouse_func(int button, int state, int x, int y)
+void Bodies::UpdatePose(std::size_t k)
 {
-    if((button == GLUT_LEFT_BUTTON) && (state == GLUT_DOWN))
+    // move according to the current speed
+    x[k] = DistanceNormalize(x[k] + (v[k] * cos(a[k])));
+    y[k] = DistanceNormalize(y[k] + (v[k] * sin(a[k])));
+    a[k] = AngleNormalize(a[k] + w[k]);
+}
+
+void Bodies::MoveInto(std::size_t k, Bodies& next) const
+{
+    const real xk = x[k], yk = y[k], ak = a[k], vk = v[k], wk = w[k];
+    const uint32_t idk = id[k];
+
+    next.x[k] = DistanceNormalize(xk + (vk * cos(ak)));
+    next.y[k] = DistanceNormalize(yk + (vk * sin(ak)));
+    next.a[k] = AngleNormalize(ak + wk);
+    next.v[k] = vk;
+    next.w[k] = wk;
+    next.id[k] = idk;
+    next.slot[idk] = k;
+}
+
+void Bodies::Swap(Bodies& other)
+{
+    std::swap(x, other.x);
+    std::swap(y, other.y);
+    std::swap(a, other.a);
+    std::swap(v, other.v);
+    std::swap(w, other.w);
+    std::swap(id, other.id);
+    std::swap(slot, other.slot);
+    std::swap(block, other.block);
+    std::swap(placed, other.placed);
+    std::swap(count, other.count);
+    std::swap(capacity, other.capacity);
+}
+
+// spread the low 16 bits of n out to the even bits
+static inline uint32_t SpreadBits(uint32_t n)
+{
+    n &= 0x0000ffff;
+    n = (n | (n << 8)) & 0x00ff00ff;
+    n = (n | (n << 4)) & 0x0f0f0f0f;
+    n = (n | (n << 2)) & 0x33333333;
+    n = (n | (n << 1)) & 0x55555555;
+    return n;
+}
+
+// put the slots of one array in the new order
+template<typename T>
+static void Permute(T* values, const std::vector<uint64_t>& order, std::vector<T>& scratch)
+{
+    const std::size_t n = scratch.size();
+    std::size_t k = 0;
+
+    for(; k < n; ++k)
     {
-        Uni::paused = !Uni::paused;
+        scratch[k] = values[(uint32_t)order[k]];
     }
+
+    memcpy(values, &scratch[0], n * sizeof(T));
 }
 
-#endif // GRAPHICS
+void Bodies::SortByMorton(real worldsize)
+{
+    if(count < 2)
+    {
+        return;
+    }
 
-Robot::Robot()
-    : pose(),
-        speed(),
-        color(),
-        pixels(pixel_count),
-        callback(NULL),
-        callback_data(NULL)
+    order.resize(count);
+    scratch.resize(count);
+    id_scratch.resize(count);
+
+    // 16 bits of each coordinate makes a 32 bit code, which is plenty to
+    // get neighbours onto the same cache lines
+    const double scale = 65535.0 / worldsize;
+    std::size_t k = 0;
+
+    for(; k < count; ++k)
+    {
+        uint32_t cx = (uint32_t)(x[k] * scale);
+        uint32_t cy = (uint32_t)(y[k] * scale);
+        uint64_t code = SpreadBits(cx) | (SpreadBits(cy) << 1);
+        order[k] = (code << 32) | k;
+    }
+
+    std::sort(order.begin(), order.end());
+
+    Permute(x, order, scratch);
+    Permute(y, order, scratch);
+    Permute(a, order, scratch);
+    Permute(v, order, scratch);
+    Permute(w, order, scratch);
+    Permute(id, order, id_scratch);
+
+    for(k = 0; k < count; ++k)
+    {
+        slot[id[k]] = k;
+    }
+}
+
+NeighbourLists::NeighbourLists()
+    : skin(0),
+        queries(0),
+        travelled(0)
 {
-    // until C++ supports array literals in the initialization list, we're forced to do this
-    memset(pose, 0, sizeof(pose));
-    memset(speed, 0, sizeof(speed));
-    color[0] = 128;
-    color[1] = 0;
-    color[2] = 0;
+}
+
+void NeighbourLists::Setup(std::size_t n, double skin)
+{
+    this->skin = skin;
+    members.resize(n);
+    moved.resize(n);
+    built_at.resize(n);
+    Invalidate();
+}
+
+std::size_t NeighbourLists::CountStale() const
+{
+    std::size_t i = 0, stale = 0, n = members.size();
+
+    for(; i < n; ++i)
+    {
+        stale += Stale(i);
+    }
+
+    return stale;
+}
+
+void NeighbourLists::Invalidate()
+{
+    std::fill(moved.begin(), moved.end(), HUGE_VAL);
+}
+
+void NeighbourLists::Keep(uint32_t i, real x, real y, Neighbours& candidates)
+{
+    std::size_t j = 0, candidate_count = candidates.size();
+
+    if(candidates.keep.size() < candidate_count)
+    {
+        candidates.keep.resize(candidate_count);
+        candidates.dx.resize(candidate_count);
+        candidates.dy.resize(candidate_count);
+    }
+
+    std::size_t survivor_count = 0;
+    if(candidate_count > 0)
+    {
+        survivor_count = FilterInRange(&candidates.x[0], &candidates.y[0], candidate_count,
+                                       x, y, worldsize, Robot::range + skin,
+                                       &candidates.keep[0], &candidates.dx[0], &candidates.dy[0]);
+    }
+
+    std::vector<uint32_t>& list = members[i];
+    list.resize(survivor_count);
+    for(; j < survivor_count; ++j)
+    {
+        list[j] = candidates.index[candidates.keep[j]];
+    }
+
+    moved[i] = 0;
+    built_at[i] = travelled;
+    __sync_fetch_and_add(&queries, 1);
+}
+
+void NeighbourLists::Gather(uint32_t i, Neighbours& candidates) const
+{
+    const std::vector<uint32_t>& list = members[i];
+    uint32_t s;
+
+    candidates.clear();
+    FOR_EACH(it, list)
+    {
+        s = bodies.slot[*it];
+        candidates.push_back(bodies.x[s], bodies.y[s], *it);
+    }
+}
+
+// give robots [begin, end) their sensors, clearing them on the thread that
+// will usually sense them
+static void attach_pixels(std::size_t begin, std::size_t end, std::size_t worker, void *data)
+{
+    pixel_arena.Attach(population, begin, end);
+    PixelArena::Clear(pixel_arena.Data() + (begin * Robot::pixel_count), (end - begin) * Robot::pixel_count);
+}
+
+// make n robots, with their sensors in the pixel arena. Start() makes the
+// pool of workers, after any fork, so this has its own.
+static void Populate(std::size_t n)
+{
+    population.assign(n, Robot());
+    pixel_arena.Allocate(n);
+
+    Anton::ThreadPool pool(thread_count);
+    pool.parallel_for(n, 4096, attach_pixels, NULL);
+}
+
+// point the robots at their sensors again, after the population has been
+// resized or reordered
+static void reattach_pixels()
+{
+    if((pixel_arena.Size() != population.size()) || (pixel_arena.PixelCount() != Robot::pixel_count))
+    {
+        pixel_arena.Allocate(population.size());
+        PixelArena::Clear(pixel_arena.Data(), population.size() * Robot::pixel_count);
+    }
+    pixel_arena.Attach(population, 0, population.size());
+}
+
+static void scatter_robots(std::size_t begin, std::size_t end, std::size_t worker, void *data)
+{
+    for(; begin < end; ++begin)
+    {
+        RandomPose(population[begin].pose, begin);
+    }
+}
+
+void Uni::RandomPoses()
+{
+    Anton::ThreadPool pool(thread_count);
+    pool.parallel_for(population.size(), 4096, scatter_robots, NULL);
 }
 
 void Uni::Init( int argc, char** argv )
@@ -139,19 +598,73 @@ void Uni::Init( int argc, char** argv )
     bool quiet = false; // controls output verbosity
 
     int population_size = 100;
-    population.resize(population_size);
 
     // parse arguments to configure Robot static members
     // opterr = 0; // supress errors about bad options
     int c;
-    while((c = getopt(argc, argv, ":?dqp:s:f:r:c:u:z:w:")) != -1)
+    while((c = getopt_long(argc, argv, ":?bdgkqDm:p:s:f:r:c:t:u:v:z:w:", long_options, NULL)) != -1)
     {
         switch( c )
         {
+            case 256:
+                stats_json = optarg;
+                if(!quiet) printf( "[Uni] stats_json: %s\n", stats_json );
+                break;
+            case 257:
+                rank_count = atoi( optarg );
+                if(rank_count < 1) rank_count = 1;
+                if(!quiet) printf( "[Uni] ranks: %u\n", rank_count );
+                break;
+            case 258:
+                shared_count = atoi( optarg );
+                if(shared_count < 1) shared_count = 1;
+                if(!quiet) printf( "[Uni] shared memory processes: %u\n", shared_count );
+                break;
+            case 259:
+                save_file = optarg;
+                if(!quiet) printf( "[Uni] save: %s\n", save_file );
+                break;
+            case 260:
+                save_period = atoi( optarg );
+                if(!quiet) printf( "[Uni] save_period: %u\n", save_period );
+                break;
+            case 261:
+                load_file = optarg;
+                if(!quiet) printf( "[Uni] load: %s\n", load_file );
+                break;
+            case 262:
+                trajectory_file = optarg;
+                if(!quiet) printf( "[Uni] trajectory: %s\n", trajectory_file );
+                break;
+            case 263:
+                trajectory_stride = atoi( optarg );
+                if(trajectory_stride < 1) trajectory_stride = 1;
+                if(!quiet) printf( "[Uni] trajectory_stride: %u\n", trajectory_stride );
+                break;
+            case 264:
+                trajectory_lz = true;
+                if(!quiet) puts( "[Uni] trajectory compression" );
+                break;
+            case 265:
+                random_seed = strtoull( optarg, NULL, 0 );
+                srand48( random_seed );
+                if(!quiet) printf( "[Uni] seed: %lu\n", (long unsigned)random_seed );
+                break;
+            case 266:
+                per_robot = true;
+                if(!quiet) puts( "[Uni] per-robot callbacks" );
+                break;
+            case 267:
+                trajectory_exact = true;
+                if(!quiet) puts( "[Uni] exact trajectory" );
+                break;
+            case 'm':
+                sort_period = atoi( optarg );
+                if(!quiet) printf( "[Uni] sort_period: %u\n", sort_period );
+                break;
             case 'p':
                 population_size = atoi( optarg );
                 if(!quiet) printf( "[Uni] population_size: %d\n", population_size );
-                population.resize( population_size );
                 break;
             case 's':
                 worldsize = atof( optarg );
@@ -165,19 +678,44 @@ void Uni::Init( int argc, char** argv )
                 Robot::range = atof( optarg );
                 if(!quiet) printf( "[Uni] range: %.2f\n", Robot::range );
                 break;
+            case 'b':
+                sector_binning = true;
+                if(!quiet) puts( "[Uni] sector binning" );
+                break;
             case 'c':
                 Robot::pixel_count = atoi( optarg );
                 if(!quiet) printf( "[Uni] pixel_count: %d\n", Robot::pixel_count );
                 break;
+            case 'D':
+                double_buffered = true;
+                if(!quiet) puts( "[Uni] double-buffered" );
+                break;
+            case 'g':
+                use_grid = true;
+                if(!quiet) puts( "[Uni] spatial index: grid" );
+                break;
+            case 'k':
+                incremental_tree = true;
+                if(!quiet) puts( "[Uni] incremental quadtree" );
+                break;
+            case 't':
+                thread_count = atoi( optarg );
+                if(thread_count < 1) thread_count = 1;
+                if(!quiet) printf( "[Uni] thread_count: %u\n", thread_count );
+                break;
             case 'u':
                 updates_max = atol( optarg );
                 if(!quiet) printf( "[Uni] updates_max: %lu\n", (long unsigned)updates_max );
                 break;
+            case 'v':
+                skin = atof( optarg );
+                if(skin < 0) skin = 0;
+                if(!quiet) printf( "[Uni] skin: %.3f\n", skin );
+                break;
             case 'z':
                 sleep_msec = atoi( optarg );
                 if(!quiet) printf( "[Uni] sleep_msec: %d\n", sleep_msec );
                 break;
-#if GRAPHICS
             case 'w':
                 winsize = atoi( optarg );
                 if(!quiet) printf( "[Uni] winsize: %d\n", winsize );
@@ -188,7 +726,6 @@ void Uni::Init( int argc, char** argv )
                 break;
             case 'q': quiet = true;
                 break;
-#endif
             case '?':
                 puts( usage );
                 exit(0); // ok
@@ -200,145 +737,223 @@ void Uni::Init( int argc, char** argv )
         }
     }
 
-#if GRAPHICS
-    // initialize opengl graphics
-    glutInit(&argc, argv);
-    glutInitWindowSize(winsize, winsize);
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA);
-    glutCreateWindow(PROGNAME);
-    glClearColor(0.8, 0.8, 1.0, 1.0);
-    glutDisplayFunc(display_func);
-    glutTimerFunc(50, timer_func, 0);
-    glutMouseFunc(mouse_func);
-    glutIdleFunc(idle_func);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_BLEND);
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    gluOrtho2D(0, 1, 0, 1);
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-    glScalef(1.0/worldsize, 1.0/worldsize, 1);
+    // the controller sets up as many robots as the checkpoint holds, and
+    // Start() fills them in
+    if(load_file != NULL)
+    {
+        std::size_t robots;
+        if(!ReadCheckpointSize(load_file, robots, worldsize))
+        {
+            exit(-1);
+        }
 
-    // define a display list for a robot body
-    double h = 0.01;
-    double w = 0.01;
+        population_size = robots;
+        if(!quiet) printf( "[Uni] population_size: %lu worldsize: %.2f from %s\n", (long unsigned)robots, worldsize, load_file );
+    }
 
-    glPointSize( 4.0 );
+    // the robots are made once every option that shapes them is known
+    Populate(population_size);
 
-    displaylist = glGenLists(1);
-    glNewList(displaylist, GL_COMPILE);
+    // every strip has to be wide enough that only its neighbours can see into it
+    unsigned int widest = (unsigned int)std::max(1.0, floor(worldsize / (2 * Robot::range)));
+    if(rank_count > widest)
+    {
+        rank_count = widest;
+        if(!quiet) printf( "[Uni] strips are at least twice the range wide, ranks: %u\n", rank_count );
+    }
+    if((rank_count > 1) && (shared_count > 1))
+    {
+        shared_count = 1;
+        fputs( "[Uni] --ranks and --shm don't mix, using --ranks.\n", stderr );
+    }
+    if(((rank_count > 1) || (shared_count > 1)) && (frontend != NULL))
+    {
+        rank_count = 1;
+        shared_count = 1;
+        fputs( "[Uni] --ranks and --shm need universe-headless, running in one process.\n", stderr );
+    }
+    if((rank_count > 1) && (incremental_tree || (skin > 0) || (sort_period > 0)))
+    {
+        incremental_tree = false;
+        skin = 0;
+        sort_period = 0;
+        if(!quiet) puts( "[Uni] -k, -v and -m keep state per robot between steps and are off with --ranks" );
+    }
+    if((shared_count > 1) && (incremental_tree || (skin > 0) || (sort_period > 0)))
+    {
+        incremental_tree = false;
+        skin = 0;
+        sort_period = 0;
+        if(!quiet) puts( "[Uni] -k, -v and -m change state shared by every process and are off with --shm" );
+    }
+    if((shared_count > 1) && !use_grid)
+    {
+        use_grid = true;
+        if(!quiet) puts( "[Uni] spatial index: grid, built in shared memory by every process" );
+    }
+    if(((rank_count > 1) || (shared_count > 1)) && ((save_file != NULL) || (trajectory_file != NULL)))
+    {
+        save_file = NULL;
+        trajectory_file = NULL;
+        fputs( "[Uni] --save and --trajectory only work in one process.\n", stderr );
+    }
 
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    SelectFilterKernel(NULL);
+    if(!quiet) printf( "[Uni] range filter: %s, %s precision\n", FilterKernelName(), UNIVERSE_PRECISION );
 
-    glBegin(GL_POLYGON);
-    glVertex2f(h/2.0, 0);
-    glVertex2f(-h/2.0, w/2.0);
-    glVertex2f(-h/2.0, -w/2.0);
-    glEnd();
+    print_stats = !quiet;
+    atexit(report_stats);
 
-    glEndList();
-#endif // GRAPHICS
+    if(frontend != NULL)
+    {
+        frontend->init(argc, argv);
+    }
 
     struct timeval start;
     gettimeofday(&start, NULL);
     lastseconds = start.tv_sec + start.tv_usec/1e6;
 }
 
-void Robot::UpdateSensor()
+// collects the hits of a spatial index query as population indices
+struct NeighbourCollector
+{
+    Neighbours &found;
+    const Robot *first;
+    NeighbourCollector(Neighbours &_found) : found(_found), first(&population[0]) {}
+    void operator()(const Anton::leaf &l) { found.push_back(l.x, l.y, l.robot - first); }
+};
+
+// find any robots that may be within reach of (x, y). The grid cells must
+// be at least reach wide.
+static void FindNeighbours(real x, real y, real reach, Neighbours &found)
 {
-    quadrant.clear();
+    NeighbourCollector collect(found);
 
-    double radians_per_pixel = fov / (double)pixel_count;
-    double halfworld = worldsize * 0.5f;
+    found.clear();
 
-    // initialize pixels vector
-    FOR_EACH(it, pixels)
+    if(use_grid)
     {
-        it->range = Robot::range; // maximum range
-        it->robot = NULL; // nothing detected
+        grid->visit_in_range(x, y, collect);  // robots in the neighbouring cells
     }
+    else
+    {
+        real search_range = (reach * 2);
 
-    double search_range = (Robot::range * 2);
+        Anton::box query(x, y, search_range, search_range);
+        tree->visit_in_range(query, collect);  // find any robots in torus range
+    }
+}
+
+// the sensor configuration, worked out once by SetupSensor() instead of in
+// every call to Sense()
+static struct SensorSetup
+{
+    bool ready;
+    unsigned int pixel_count;
+    real fov;
+    real range;
+    real half_fov;
+    real radians_per_pixel;
+    Robot::Pixel nothing;    // a pixel that has detected nothing
+} sensor = { false, 0, 0, 0, 0, 0, Robot::Pixel() };
+
+typedef void (*SenseKernel)(real x, real y, real a, uint32_t self, Neighbours &candidates, Robot::Pixel *pixels);
+
+// fill in the pixels of robot self at pose (x, y, a) from its neighbours.
+// PIXELS is the pixel count, known at compile time so the loops over the
+// pixels unroll and the wrap of the pixel index is a constant modulo, or
+// 0 for any count. The binning still divides by radians_per_pixel, since
+// multiplying by its reciprocal would round differently at pixel edges.
+template<unsigned int PIXELS>
+static void Sense(real x, real y, real a, uint32_t self, Neighbours &candidates, Robot::Pixel *pixels)
+{
+    const unsigned int pixel_count = (PIXELS > 0) ? PIXELS : sensor.pixel_count;
+    const real radians_per_pixel = sensor.radians_per_pixel;
 
-    Anton::box query(pose[0], pose[1], search_range, search_range);
-    //quadrant = tree->get_leaves_at(query);
-    quadrant = tree->find_in_range(query);  // find any robots in torus range
+    // nothing detected yet
+    std::fill_n(pixels, pixel_count, sensor.nothing);
 
-    std::size_t i = 0, quadrant_size = quadrant.size();
-    double dx, dy, range, absolute_heading, relative_heading;
+    std::size_t i = 0, candidate_count = candidates.size();
+    real dx, dy, range, absolute_heading, relative_heading;
     int pixel;
 
-    // check every robot near by to see if it is detected
-    for(; i < quadrant_size; ++i)
+    if(candidate_count == 0)
     {
-        Robot *other = quadrant[i];
-
-        // discard if it's the same robot
-        if(other == this)
-        {
-            continue;
-        }
-
-        // discard if it's out of range. We put off computing the
-        // hypotenuse as long as we can, as it's relatively expensive
+        return;
+    }
 
-        dx = other->pose[0] - pose[0];
+    // heading of the robot, for turning offsets into its own frame
+    real heading_x = 0, heading_y = 0;
+    if(sector_binning)
+    {
+        heading_x = std::cos(a);
+        heading_y = std::sin(a);
+    }
 
-        // wrap around torus
-        if(dx > halfworld)
-            dx -= worldsize;
-        else if(dx < -halfworld)
-            dx += worldsize;
+    // throw out everything that is clearly out of range in one pass
+    if(candidates.keep.size() < candidate_count)
+    {
+        candidates.keep.resize(candidate_count);
+        candidates.dx.resize(candidate_count);
+        candidates.dy.resize(candidate_count);
+    }
 
-        if(fabs(dx) > Robot::range)
-        {
-            continue;   // out of range
-        }
+    std::size_t survivor_count = FilterInRange(&candidates.x[0], &candidates.y[0], candidate_count,
+                                               x, y, worldsize, Robot::range,
+                                               &candidates.keep[0], &candidates.dx[0], &candidates.dy[0]);
 
-        dy = other->pose[1] - pose[1];
+    // check every robot near by to see if it is detected
+    for(; i < survivor_count; ++i)
+    {
+        uint32_t other = candidates.index[candidates.keep[i]];
 
-        // wrap around torus
-        if(dy > halfworld)
-        {
-            dy -= worldsize;
-        }
-        else if(dy < -halfworld)
+        // discard if it's the same robot
+        if(other == self)
         {
-            dy += worldsize;
+            continue;
         }
 
-        if(fabs(dy) > Robot::range)
-        {
-            continue;   // out of range
-        }
+        dx = candidates.dx[i];
+        dy = candidates.dy[i];
 
-        range = hypot(dx, dy);
+        // the filter is generous, so check the exact distance
+        range = std::hypot(dx, dy);
 
         if(range > Robot::range)
         {
             continue;
         }
 
-        // discard if it's out of field of view
-        absolute_heading = atan2(dy, dx);
-        relative_heading = AngleNormalize((absolute_heading - pose[2]));
-
-        if(fabs(relative_heading) > (fov/2.0))
+        if(sector_binning)
         {
-            continue;
+            // find which pixel it falls in, or discard if it's out of field of view
+            if(!sectors.Bin((dx * heading_x) + (dy * heading_y), (dy * heading_x) - (dx * heading_y), pixel))
+            {
+                continue;
+            }
+        }
+        else
+        {
+            // discard if it's out of field of view
+            absolute_heading = std::atan2(dy, dx);
+            relative_heading = AngleNormalize((absolute_heading - a));
+
+            if(std::fabs(relative_heading) > sensor.half_fov)
+            {
+                continue;
+            }
+
+            // find which pixel it falls in
+            pixel = std::floor( relative_heading / radians_per_pixel );
+            pixel += pixel_count / 2;
+            pixel %= pixel_count;
         }
-
-        // find which pixel it falls in
-        pixel = floor( relative_heading / radians_per_pixel );
-        pixel += pixel_count / 2;
-        pixel %= pixel_count;
 
         assert(pixel >= 0);
         assert(pixel < (int)pixel_count);
 
         // discard if we've seen something closer in this pixel already.
-        if(pixels[pixel].range < range)
+        if(pixels[pixel].range < (float)range)
         {
             continue;
         }
@@ -349,6 +964,59 @@ void Robot::UpdateSensor()
     }
 }
 
+static SenseKernel sense_kernel(Sense<0>);
+static bool specialized_sense(true); // see SelectSenseKernel()
+
+// pick the sense kernel for the pixel count and work out the sensor
+// geometry, if the sensor has changed since the last time
+static void SetupSensor()
+{
+    if(sensor.ready && (sensor.pixel_count == Robot::pixel_count) && (sensor.fov == Robot::fov)
+       && (sensor.range == Robot::range))
+    {
+        return;
+    }
+
+    sensor.ready = true;
+    sensor.pixel_count = Robot::pixel_count;
+    sensor.fov = Robot::fov;
+    sensor.range = Robot::range;
+    sensor.half_fov = Robot::fov / 2;
+    sensor.radians_per_pixel = Robot::fov / (real)Robot::pixel_count;
+    PixelArena::Clear(&sensor.nothing, 1);
+    sectors.Setup(Robot::fov, Robot::pixel_count);
+
+    switch(specialized_sense ? Robot::pixel_count : 0)
+    {
+        case 8: sense_kernel = Sense<8>; break;
+        case 16: sense_kernel = Sense<16>; break;
+        case 32: sense_kernel = Sense<32>; break;
+        case 64: sense_kernel = Sense<64>; break;
+        default: sense_kernel = Sense<0>; break;
+    }
+}
+
+void Uni::SelectSenseKernel(bool specialized)
+{
+    specialized_sense = specialized;
+    sensor.ready = false;
+    SetupSensor();
+}
+
+void Robot::UpdateSensor()
+{
+    UpdateSensor(quadrant);
+}
+
+void Robot::UpdateSensor(Neighbours &candidates)
+{
+    FindNeighbours(pose[0], pose[1], Robot::range, candidates);
+    if(!pixels.empty())
+    {
+        sense_kernel(pose[0], pose[1], pose[2], this - &population[0], candidates, pixels.begin());
+    }
+}
+
 void Robot::UpdatePose()
 {
     // move according to the current speed
@@ -358,121 +1026,514 @@ void Robot::UpdatePose()
     pose[2] = AngleNormalize(pose[2] + speed[1]);   // pose[2] + da
 }
 
+// sensing job for the worker threads. The spatial index and the bodies
+// are only read here.
+static void sense_robots(std::size_t begin, std::size_t end, std::size_t worker, void *data)
+{
+    Neighbours &candidates = worker_quadrants[worker];
+
+    begin += slice_first;
+    end += slice_first;
+
+    for(; begin < end; ++begin)
+    {
+        if(skin > 0)
+        {
+            uint32_t id = bodies.id[begin];
+
+            if(neighbour_lists.Stale(id))
+            {
+                FindNeighbours(bodies.x[begin], bodies.y[begin], Robot::range + skin, candidates);
+                neighbour_lists.Keep(id, bodies.x[begin], bodies.y[begin], candidates);
+            }
+
+            neighbour_lists.Gather(id, candidates);
+        }
+        else
+        {
+            FindNeighbours(bodies.x[begin], bodies.y[begin], Robot::range, candidates);
+        }
+
+        Robot::Pixel *pixels = (batch_callback != NULL)
+            ? &block_pixels[begin * Robot::pixel_count]
+            : population[bodies.id[begin]].pixels.begin();
+        sense_kernel(bodies.x[begin], bodies.y[begin], bodies.a[begin], bodies.id[begin], candidates, pixels);
+    }
+}
+
+// pose job for the worker threads. Every slot is moved into the bodies
+// passed as data, and with -v each worker keeps its longest step and most
+// stale list.
+static void move_robots(std::size_t begin, std::size_t end, std::size_t worker, void *data)
+{
+    Bodies &moved = *static_cast<Bodies*>(data);
+    double longest = worker_longest[worker], slack = worker_slack[worker];
+
+    begin += slice_first;
+    end += slice_first;
+
+    for(; begin < end; ++begin)
+    {
+        bodies.MoveInto(begin, moved);
+        moved.Store(begin, population[moved.id[begin]]);
+
+        if(skin > 0)
+        {
+            uint32_t id = moved.id[begin];
+            double step = fabs(moved.v[begin]);
+            neighbour_lists.Moved(id, step);
+            longest = std::max(longest, step);
+            slack = std::max(slack, neighbour_lists.Slack(id));
+        }
+    }
+
+    worker_longest[worker] = longest;
+    worker_slack[worker] = slack;
+}
+
+// copy the population as it was sensed
+static void copy_snapshot(std::size_t begin, std::size_t end, std::size_t worker, void *data)
+{
+    for(; begin < end; ++begin)
+    {
+        snapshot[begin] = population[begin];
+    }
+}
+
+// per-robot callback job for the worker threads. The pixels of every robot
+// point into the snapshot, so a callback never sees another one's changes.
+static void call_robots(std::size_t begin, std::size_t end, std::size_t worker, void *data)
+{
+    begin += slice_first;
+    end += slice_first;
+
+    for(; begin < end; ++begin)
+    {
+        Robot &b = population[bodies.id[begin]];
+        b.callback(b, b.callback_data);
+        if((b.pose[0] != bodies.x[begin]) || (b.pose[1] != bodies.y[begin]))
+        {
+            __sync_fetch_and_or(&teleported_any, 1);
+        }
+        bodies.Load(begin, b);
+    }
+}
+
+// control job for the worker threads
+static void control_robots(std::size_t begin, std::size_t end, std::size_t worker, void *data)
+{
+    RobotBlock block;
+
+    begin += slice_first;
+    end += slice_first;
+
+    block.first = begin;
+    block.count = end - begin;
+    block.pixel_count = Robot::pixel_count;
+    block.pixels = &block_pixels[begin * Robot::pixel_count];
+    block.id = bodies.id + begin;
+    block.x = bodies.x + begin;
+    block.y = bodies.y + begin;
+    block.a = bodies.a + begin;
+    block.v = bodies.v + begin;
+    block.w = bodies.w + begin;
+
+    batch_callback(block, batch_data);
+}
+
+// the end of a run, whichever front-end stepped it
+static void finish_run()
+{
+    // leave each rank with just its own robots
+    population.resize(owned_count);
+
+    if(save_file != NULL)
+    {
+        SaveCheckpoint(save_file, bodies, population, updates);
+    }
+}
+
 void Uni::UpdateAll()
 {
-    // if we've done enough updates, exit the program
+    // if we've done enough updates, exit the program. The GLUT front-end
+    // never returns to Run(), so this is where its runs end.
     if((updates_max > 0) && (updates > updates_max))
     {
         /*FOR_EACH(r, population)
         {
             std::cout << r->pose[0] << " " << r->pose[1] << std::endl;
         }*/
-        exit(1);
+        finish_run();
+        exit(0);
     }
 
     if(!paused)
     {
-        FOR_EACH(r, population)
+        // with the world split, the population ends with ghosts from the
+        // neighbouring strips which are only there to be sensed
+        std::size_t population_size = domain.Active() ? owned_count : population.size();
+        std::size_t k;
+
+        // Under -D every phase runs on the worker threads. No phase reads
+        // what another thread of it writes: the pose pass reads the bodies
+        // and writes next_bodies, sensing reads the new poses and writes
+        // each robot's own pixels, and the callbacks look at a snapshot of
+        // the robots as sensed. So the bits are the same for any number of
+        // threads and any schedule.
+
+        // the slots this process steps, which is all of them unless the
+        // population is shared with other processes
+        const std::size_t first = shared.Active() ? shared.first : 0;
+        std::size_t last = shared.Active() ? shared.last : population_size;
+        slice_first = first;
+
+        step_stats.Begin();
+
+        // keep robots that are close together close in memory
+        if((sort_period > 0) && ((updates % sort_period) == 0))
+        {
+            bodies.SortByMorton(worldsize);
+        }
+        step_stats.Mark(PHASE_SORT);
+
+        // the Robot poses follow along for drawing and callbacks. Each slot
+        // is on its own, so this runs on the pool with or without -D. The
+        // shared bodies of --shm are moved in place, each process its own
+        // slots, and the barriers keep the others from reading them.
+        bool buffer_poses = double_buffered && !shared.Active();
+        if(buffer_poses)
         {
-            r->UpdatePose();
+            next_bodies.Allocate(bodies.Size());
+        }
+        std::fill(worker_longest.begin(), worker_longest.end(), 0.0);
+        std::fill(worker_slack.begin(), worker_slack.end(), -HUGE_VAL);
+        workers->parallel_for(last - first, control_grain, move_robots, buffer_poses ? &next_bodies : &bodies);
+        if(buffer_poses)
+        {
+            bodies.Swap(next_bodies);
+        }
+
+        // the index is only needed when some robot's neighbour list is out
+        // of date, but the incremental tree has to follow every move
+        bool build_index = true;
+        if(skin > 0)
+        {
+            neighbour_lists.Advance(*std::max_element(worker_longest.begin(), worker_longest.end()));
+
+            double slack = *std::max_element(worker_slack.begin(), worker_slack.end());
+            build_index = incremental_tree || neighbour_lists.AnyStale(slack);
         }
 
-        // add robots to tree
-        FOR_EACH(it, population)
+        step_stats.Mark(PHASE_POSE);
+
+        if(domain.Active())
+        {
+            owned_count = domain.Exchange(population, population_size, Robot::range);
+            population_size = owned_count;
+            last = owned_count;
+            bodies.Load(population);
+            reattach_pixels();
+        }
+        else if(shared.Active())
         {
-            tree->add_leaf(&(*it));
+            // everyone's new positions and counts for the grid are needed
+            // to index and sense
+            grid->count_slice(bodies.x, bodies.y, first, last, shared.rank);
+            shared.Barrier();
+            for(k = 0; k < population_size; ++k)
+            {
+                bodies.Store(k, population[bodies.id[k]]);
+            }
         }
+        step_stats.Mark(PHASE_EXCHANGE);
 
-        FOR_EACH(r, population)
+        // add robots to the spatial index, ghosts too. Without it every
+        // robot senses from its neighbour list.
+        const std::size_t indexed = population.size();
+        if(shared.Active())
+        {
+            // every process files its own robots into the shared grid
+            grid->fill_slice(bodies.x, bodies.y, &population[0], bodies.id, first, last, shared.rank);
+            shared.Barrier();
+        }
+        else if(build_index && use_grid)
+        {
+            grid->build(bodies.x, bodies.y, &population[0], bodies.id, indexed);
+        }
+        else if(build_index && incremental_tree)
         {
-            r->UpdateSensor();
+            // robot ids are the handles, so sorting the slots doesn't matter
+            for(k = 0; k < population_size; ++k)
+            {
+                if(!tree_filled)
+                {
+                    tree->insert_leaf(bodies.id[k], &population[bodies.id[k]], bodies.x[k], bodies.y[k]);
+                }
+                else
+                {
+                    tree->move_leaf(bodies.id[k], bodies.x[k], bodies.y[k]);
+                }
+            }
+            tree_filled = true;
         }
+        else if(build_index)
+        {
+            // starts from an empty tree, whatever BuildIndex() left in it
+            tree->build(bodies.x, bodies.y, &population[0], bodies.id, indexed, *workers);
+        }
+
+        step_stats.Mark(PHASE_INDEX);
 
-        //tree->clear();
-        tree->flush();
+        if(batch_callback != NULL)
+        {
+            block_pixels.resize(population_size * Robot::pixel_count);
+        }
 
-        FOR_EACH(r, population)
+        // per-robot callbacks in parallel look at a copy of the robots
+        bool use_snapshot = double_buffered && (batch_callback == NULL);
+        if(use_snapshot)
         {
-            Robot &b = *r;
-            r->callback(b, r->callback_data);
+            snapshot.resize(indexed);
         }
+        seen = use_snapshot ? &snapshot[0] : &population[0];
+
+        SetupSensor();
+        workers->parallel_for(last - first, sense_grain, sense_robots, NULL);
+
+        // the others may still be reading the shared bodies and grid, which
+        // the callbacks are about to change
+        if(shared.Active())
+        {
+            shared.Barrier();
+        }
+        step_stats.Mark(PHASE_SENSE);
+
+        if(build_index && !use_grid && !incremental_tree)
+        {
+            tree->flush();
+            tree_filled = false;
+        }
+        step_stats.Mark(PHASE_FLUSH);
+
+        // pick up whatever the callbacks changed
+        bool teleported = false;
+        if(batch_callback != NULL)
+        {
+            workers->parallel_for(last - first, control_grain, control_robots, NULL);
+
+            // the robots' own pixels are only looked at by the front-end
+            for(k = 0; (frontend != NULL) && (k < population_size); ++k)
+            {
+                std::copy(&block_pixels[k * Robot::pixel_count], &block_pixels[(k + 1) * Robot::pixel_count],
+                          population[bodies.id[k]].pixels.begin());
+            }
+        }
+        else if(use_snapshot)
+        {
+            workers->parallel_for(indexed, control_grain, copy_snapshot, NULL);
+
+            teleported_any = 0;
+            workers->parallel_for(last - first, control_grain, call_robots, NULL);
+            teleported = (teleported_any != 0);
+        }
+        else
+        {
+            for(k = first; k < last; ++k)
+            {
+                Robot &b = population[bodies.id[k]];
+                b.callback(b, b.callback_data);
+                teleported = teleported || (b.pose[0] != bodies.x[k]) || (b.pose[1] != bodies.y[k]);
+                bodies.Load(k, b);
+            }
+        }
+
+        // a robot put somewhere new may be next to anyone
+        if((skin > 0) && teleported)
+        {
+            neighbour_lists.Invalidate();
+        }
+
+        step_stats.Mark(PHASE_CALLBACKS);
+
+        if(trajectory.IsOpen() && ((updates % trajectory_stride) == 0))
+        {
+            trajectory.Record(bodies, updates);
+        }
+        step_stats.Mark(PHASE_LOG);
+        step_stats.End(last - first);
 
         need_redraw = true;
 
-        if((updates % period) == 0)
+        if(((updates % period) == 0) && (domain.rank == 0) && (shared.rank == 0))
         {
             struct timeval now;
             gettimeofday( &now, NULL );
             double seconds = now.tv_sec + now.tv_usec/1e6;
             double interval = seconds - lastseconds;
-            printf("[%d] FPS %.3f\r", (int)updates, (period/interval));
+            if(skin > 0)
+                printf("[%d] FPS %.3f queries %lu\r", (int)updates, (period/interval), neighbour_lists.queries);
+            else
+                printf("[%d] FPS %.3f\r", (int)updates, (period/interval));
             fflush(stdout);
             lastseconds = seconds;
         }
     }
 
     ++updates;
+
+    if((save_file != NULL) && (save_period > 0) && ((updates % save_period) == 0))
+    {
+        SaveCheckpoint(save_file, bodies, population, updates);
+    }
+}
+
+// write the last of the trajectory
+static void close_trajectory()
+{
+    trajectory.Close();
+    if(print_stats)
+    {
+        fprintf(stderr, "\n[Uni] trajectory: %lu frames, the writer fell behind %lu times\n",
+                (long unsigned)trajectory.Frames(), (long unsigned)trajectory.Stalls());
+    }
 }
 
-// draw a robot
-void Robot::Draw() const
+// the first process outlives the others, so the whole run can be timed
+static void wait_for_ranks()
 {
-#if GRAPHICS
-    glPushMatrix();
-    glTranslatef(pose[0], pose[1], 0);
-    glRotatef(rtod(pose[2]), 0, 0, 1);
+    domain.Wait();
+    shared.Wait();
+}
 
-    glColor3ub(color[0], color[1], color[2]);
+void Uni::Start()
+{
+    if(workers != NULL)
+    {
+        return; // already started
+    }
 
-    // draw the pre-compiled triangle for a body
-    glCallList(displaylist);
+    double half_dimension = worldsize/2.0f;
+    unsigned int max_leaves = 10;
+    Anton::box bounds(half_dimension, half_dimension, worldsize, worldsize);
 
-    if(show_data)
+    if(use_grid)
+    {
+        grid = new Anton::SpatialGrid(worldsize, Robot::range + skin);
+    }
+    else
     {
-        // render the sensors
-        double rads_per_pixel = fov / (double)pixel_count;
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        tree = new Anton::QuadTree(bounds, max_leaves);
+    }
 
-        double angle, dx1, dy1, dx2, dy2;
-        double half_rads_per_pixel = (rads_per_pixel/2.0);
-        unsigned int p = 0;
+    // the bodies of a checkpoint are used where they are mapped, unless
+    // the robots are split up
+    bool loaded = false;
+    if(load_file != NULL)
+    {
+        if(!LoadCheckpoint(load_file, bodies, population, updates))
+        {
+            exit(-1);
+        }
+        loaded = true;
+    }
 
-        for(; p < pixel_count; ++p)
+    if(rank_count > 1)
+    {
+        domain.Split(rank_count, population);
+        if(domain.rank == 0)
         {
-            angle = -fov/2.0 + (p+0.5) * rads_per_pixel;
-            dx1 = pixels[p].range * cos(angle + half_rads_per_pixel);
-            dy1 = pixels[p].range * sin(angle + half_rads_per_pixel);
-            dx2 = pixels[p].range * cos(angle - half_rads_per_pixel);
-            dy2 = pixels[p].range * sin(angle - half_rads_per_pixel);
+            atexit(wait_for_ranks);
+        }
+    }
+    owned_count = population.size();
+    reattach_pixels();
+    SetupSensor();
 
-            glColor4f( 1,0,0, pixels[p].robot ? 0.2 : 0.05 );
+    if(shared_count > 1)
+    {
+        shared.Split(shared_count, bodies, population, grid->shared_bytes(population.size(), shared_count));
+        grid->place(population.size(), shared_count, shared.Index());
+        if(shared.rank == 0)
+        {
+            atexit(wait_for_ranks);
+        }
+    }
+    else if(!loaded || (rank_count > 1))
+    {
+        bodies.Load(population);
+    }
+    neighbour_lists.Setup(population.size(), skin);
 
-            glBegin(GL_POLYGON);
-            glVertex2f(0, 0);
-            glVertex2f(dx1, dy1);
-            glVertex2f(dx2, dy2);
-            glEnd();
+    if(trajectory_file != NULL)
+    {
+        if(!trajectory.Open(trajectory_file, population.size(), worldsize, trajectory_lz, trajectory_exact))
+        {
+            exit(-1);
         }
+        atexit(close_trajectory);
     }
 
-    glPopMatrix();
-#endif // GRAPHICS
+    workers = new Anton::ThreadPool(thread_count);
+    worker_quadrants.resize(workers->get_thread_count());
+    worker_longest.resize(workers->get_thread_count());
+    worker_slack.resize(workers->get_thread_count());
+}
+
+void Uni::BuildIndex()
+{
+    const std::size_t population_size = population.size();
+    std::size_t k;
+
+    bodies.Load(population);
+    neighbour_lists.Setup(population_size, skin);
+    reattach_pixels();
+    SetupSensor();
+
+    if(use_grid)
+    {
+        grid->build(bodies.x, bodies.y, &population[0], bodies.id, population_size);
+        return;
+    }
+
+    tree->flush();
+    for(k = 0; incremental_tree && (k < population_size); ++k)
+    {
+        tree->insert_leaf(k, &population[k], bodies.x[k], bodies.y[k]);
+    }
+    if(!incremental_tree)
+    {
+        tree->build(bodies.x, bodies.y, &population[0], bodies.id, population_size, *workers);
+    }
+    tree_filled = true;
 }
 
 void Uni::Run()
 {
-    double half_dimension = 1.0/2.0f;
-    unsigned int max_leaves = 10;
-    Anton::box grid(half_dimension, half_dimension, 1.0, 1.0);
-    tree = new Anton::QuadTree(grid, max_leaves);
+    Start();
+
     //std::cout << "Population: " << population.size() << std::endl;
     //std::cout << "Max leaves: " << tree->get_max_leaves() << std::endl;
-#if GRAPHICS
-    glutMainLoop();
-#else
-    while(1)
+    if(frontend != NULL)
+    {
+        frontend->run();
+    }
+
+    // headless: step as fast as possible, stopping after updates_max steps
+    while((updates_max == 0) || (updates <= updates_max))
     {
         Uni::UpdateAll();
     }
-#endif
+
+    finish_run();
+}
+
+void Uni::SetFrontEnd(const FrontEnd* f)
+{
+    frontend = f;
+}
+
+void Uni::SetBatchCallback(BatchCallback callback, void* user)
+{
+    batch_callback = per_robot ? NULL : callback;
+    batch_data = user;
 }
@@ -19,8 +19,8 @@
 #include <cstring>
 #include <getopt.h>
 #include <ctime>
-
-#define GRAPHICS 1
+#include "precision.h"
+#include "random.h"
 
 // handy STL iterator macro pair. Use FOR_EACH(I,C){ } to get an iterator I to
 // each item in a collection C.
@@ -30,6 +30,7 @@
 namespace Uni
 {
     class Robot;
+    class Neighbours;
 
     /** initialization: call this before using any other calls. */
     void Init(int argc, char** argv);
@@ -37,36 +38,94 @@ namespace Uni
     /** update all robots */
     void UpdateAll();
 
-    /** Start running the simulation. Does not return. */
+    /** Start running the simulation. Returns after updates_max steps
+        unless a front-end is driving it. */
     void Run();
 
+    /** Set up the spatial index and the worker threads for the current
+        population. Run() calls this, so only tools that step or sense
+        without Run() need to. */
+    void Start();
+
+    /** Put every robot of the population into the spatial index at its
+        current pose, so Robot::UpdateSensor() can be called between steps.
+        Call Start() first. */
+    void BuildIndex();
+
+    /** Sense with a kernel built for the pixel count when there is one (8,
+        16, 32 or 64 pixels), which is the default, or always with the
+        generic kernel. */
+    void SelectSenseKernel(bool specialized);
+
+    /** Hooks for a front-end, such as the GLUT viewer, that drives the
+        step loop itself. Without one the simulation runs headless. */
+    struct FrontEnd
+    {
+        void (*init)(int argc, char** argv); // called by Init() once the options are parsed
+        void (*run)(); // called by Run(). Calls UpdateAll() for every step and does not return.
+    };
+
+    /** Install a front-end. Must be called before Init(). */
+    void SetFrontEnd(const FrontEnd* f);
+
     //void DrawQuad();
 
     extern uint64_t updates; // number of simulation steps so far
     extern uint64_t updates_max; // number of steps to run before quitting (0 means infinity)
-    extern double worldsize; // side length of the toroidal world
+    extern real worldsize; // side length of the toroidal world
+
+    // settings and state for a front-end
+    extern bool need_redraw; // the robots have moved since they were last drawn
+    extern bool paused; // UpdateAll() does nothing while set
+    extern int winsize; // initial window size in pixels
+    extern bool show_data; // draw the sensor field of view
+    extern unsigned int sleep_msec; // pause between steps
 
     class Robot
     {
     public:
         // static data members (same for all instances)
-        static double range;            // sensor detects objects up tp this maximum distance
-        static double fov;                // sensor detects objects within this angular field-of-view
+        static real range;            // sensor detects objects up tp this maximum distance
+        static real fov;                // sensor detects objects within this angular field-of-view
         static unsigned int    pixel_count; // number of pixels in sensor array
 
         // non-static data members
-        double pose[3];     // 2d pose and orientation [0]=x, [1]=y, [2]=a;
-        double speed[2];     // linear speed [0] and angular speed [1]
+        real pose[3];     // 2d pose and orientation [0]=x, [1]=y, [2]=a;
+        real speed[2];     // linear speed [0] and angular speed [1]
         uint8_t color[3];    // body color [0]=red, [1]=green, [2]=blue;
 
         class Pixel
         {
         public:
-            double range; // between zero and Robot::range
-            Robot* robot; // closest robot detected or NULL if nothing detected
+            static const uint32_t NONE = 0xffffffff;
+
+            float range; // between zero and Robot::range
+            uint32_t robot; // population index of the closest robot detected, or NONE
+
+            /** The robot detected, as it was sensed, or NULL. */
+            const Robot* Seen() const;
         };
 
-        std::vector<Pixel> pixels; // sensor array
+        /** A robot's part of the PixelArena. Copies of a robot look at the
+            same pixels. */
+        class Pixels
+        {
+        public:
+            Pixels() : first(NULL), count(0) {}
+            Pixels(Pixel* first, std::size_t count) : first(first), count(count) {}
+
+            Pixel& operator[](std::size_t i) const { return first[i]; }
+            std::size_t size() const { return count; }
+            bool empty() const { return count == 0; }
+            Pixel* begin() const { return first; }
+            Pixel* end() const { return first + count; }
+
+        private:
+            Pixel* first;
+            std::size_t count;
+        };
+
+        Pixels pixels; // sensor array
 
         // default constructor
         Robot();
@@ -83,6 +142,10 @@ namespace Uni
         // update
         void UpdateSensor();
 
+        // update using a caller-owned buffer for the nearby robots, so
+        // several threads can sense at once
+        void UpdateSensor(Neighbours &candidates);
+
         // callback function for controlling this robot
         void (*callback)(Robot& r, void* user);
         void* callback_data;;
@@ -90,10 +153,230 @@ namespace Uni
 
     extern std::vector<Robot> population;
 
+    /** The sensors of the whole population in one block, pixel_count
+        pixels per robot in population order, instead of an allocation per
+        robot. */
+    class PixelArena
+    {
+    public:
+        PixelArena();
+        ~PixelArena();
+
+        /** Make room for the sensors of n robots of Robot::pixel_count
+            pixels. The old contents are lost. */
+        void Allocate(std::size_t n);
+
+        /** Number of robots there is room for. */
+        std::size_t Size() const { return count; }
+
+        /** Pixels per robot. */
+        unsigned int PixelCount() const { return pixel_count; }
+
+        /** The pixels of robot 0, then robot 1, and so on. */
+        Robot::Pixel* Data() { return block; }
+
+        /** Point robots [begin, end) at their sensors. Separate ranges
+            may be attached by separate threads. */
+        void Attach(std::vector<Robot>& robots, std::size_t begin, std::size_t end);
+
+        /** Set every pixel of n to nothing detected. */
+        static void Clear(Robot::Pixel* pixels, std::size_t n);
+
+    private:
+        PixelArena(const PixelArena& other);
+        PixelArena& operator=(const PixelArena& other);
+        Robot::Pixel* block;
+        std::size_t count;
+        std::size_t capacity;    // pixels
+        unsigned int pixel_count;
+    };
+
+    extern PixelArena pixel_arena;
+
+    /** The state the step loop works on, stored as one array per field.
+        Slot k of every array belongs to robot id[k] of the population. The
+        slots may be reordered, but the Robot objects never move and are
+        kept in step with their slot for drawing and callbacks. */
+    class Bodies
+    {
+    public:
+        real* x;    // pose
+        real* y;
+        real* a;
+        real* v;    // linear speed
+        real* w;    // angular speed
+        uint32_t* id;    // position of the robot in the population
+        uint32_t* slot;    // slot of each robot of the population, the inverse of id
+
+        Bodies();
+        ~Bodies();
+
+        /** Make room for n robots. The old contents are lost. */
+        void Allocate(std::size_t n);
+
+        /** Bytes of memory needed to hold n robots. */
+        static std::size_t Bytes(std::size_t n);
+
+        /** Hold n robots in memory, which is at least Bytes(n) long and
+            starts on a cache line, instead of allocating. The memory is
+            not freed here. */
+        void Place(std::size_t n, void* memory);
+
+        /** Number of robots stored. */
+        std::size_t Size() const { return count; }
+
+        /** The memory holding all of the arrays, Bytes(Size()) long. */
+        const void* Data() const { return block; }
+
+        /** Copy the pose and speed of every robot in, robot i to slot i. */
+        void Load(const std::vector<Robot>& robots);
+
+        /** Copy the pose and speed of one robot in to slot k. */
+        void Load(std::size_t k, const Robot& r);
+
+        /** Copy the pose and speed of slot k out to r. */
+        void Store(std::size_t k, Robot& r) const;
+
+        /** Move the robot in slot k according to its current speed. */
+        void UpdatePose(std::size_t k);
+
+        /** Write the robot in slot k, moved as UpdatePose() would, to slot
+            k of next, which may be these bodies. */
+        void MoveInto(std::size_t k, Bodies& next) const;
+
+        /** Trade contents with other. */
+        void Swap(Bodies& other);
+
+        /** Sort the slots along a Z-order curve over the world, so robots
+            that are close in space are close in memory. */
+        void SortByMorton(real worldsize);
+
+    private:
+        Bodies(const Bodies& other);
+        Bodies& operator=(const Bodies& other);
+        static std::size_t Stride(std::size_t n);
+        void Arrange(void* memory, std::size_t stride);
+        void* block;    // one aligned allocation holding all of the arrays
+        bool placed;    // the block belongs to someone else
+        std::size_t count;
+        std::size_t capacity;
+        std::vector<uint64_t> order;    // scratch space for sorting: code << 32 | slot
+        std::vector<real> scratch;
+        std::vector<uint32_t> id_scratch;
+    };
+
+    extern Bodies bodies;
+
+    /** A block of robots handed to a batch controller. Robot i of the block
+        is in slot first + i of the bodies, and every array starts at the
+        block's first robot. */
+    struct RobotBlock
+    {
+        std::size_t first;    // slot of the first robot
+        std::size_t count;    // robots in the block
+        unsigned int pixel_count;    // pixels per robot
+        const Robot::Pixel* pixels;    // robot i sees pixels [i * pixel_count, (i + 1) * pixel_count)
+        const uint32_t* id;    // position of each robot in the population
+        const real* x;    // poses
+        const real* y;
+        const real* a;
+        real* v;    // speeds, for the controller to set
+        real* w;
+    };
+
+    /** Sets the speeds of a whole block of robots from their sensors. Blocks
+        may be handed to several threads at once, so it must only write the
+        speeds of its own block. */
+    typedef void (*BatchCallback)(const RobotBlock& block, void* user);
+
+    /** Control every robot with callback instead of calling each robot's
+        own callback. The robots' pixels are then only kept up to date for
+        a front-end to draw. Pass NULL to go back to the per-robot
+        callbacks. With --per-robot this does nothing, so call it after
+        Init(). */
+    void SetBatchCallback(BatchCallback callback, void* user);
+
+    /** The robots near each robot, cached between spatial queries. A list
+        holds every robot within range + skin of its owner when it was
+        built. It is good until its owner and the robots around it could
+        together have closed the skin, which for slow robots is many steps. */
+    class NeighbourLists
+    {
+    public:
+        double skin;
+        unsigned long queries;    // lists built, i.e. spatial queries made
+
+        NeighbourLists();
+
+        /** Start n empty lists. */
+        void Setup(std::size_t n, double skin);
+
+        /** Note that robot i moved up to distance d this step. */
+        void Moved(uint32_t i, double d) { moved[i] += d; }
+
+        /** Note that no robot moved further than d this step. */
+        void Advance(double d) { travelled += d; }
+
+        /** Does robot i need a new list? */
+        bool Stale(uint32_t i) const { return AnyStale(Slack(i)); }
+
+        /** How far robot i has moved since its list was built, less how far
+            everyone had travelled then. It only grows between lists. */
+        double Slack(uint32_t i) const { return moved[i] - built_at[i]; }
+
+        /** Is a list with this slack stale? Given the most slack of all
+            the robots, says whether any of them needs a new list. */
+        bool AnyStale(double slack) const { return (slack + travelled) > skin; }
+
+        /** Number of robots that need a new list. */
+        std::size_t CountStale() const;
+
+        /** Force every list to be rebuilt, e.g. after robots were moved by
+            something other than their speed. */
+        void Invalidate();
+
+        /** Rebuild the list of robot i at (x, y) from candidates found
+            within range + skin. */
+        void Keep(uint32_t i, real x, real y, Neighbours& candidates);
+
+        /** Replace candidates with the current positions of the robots in
+            the list of robot i. */
+        void Gather(uint32_t i, Neighbours& candidates) const;
+
+    private:
+        std::vector<std::vector<uint32_t> > members;
+        std::vector<double> moved;    // distance robot i has moved since its list was built
+        std::vector<double> built_at;    // travelled when the list of robot i was built
+        double travelled;    // sum of the longest step of every step so far
+    };
+
+    /** Robots found near a point by the spatial index, as parallel arrays. */
+    class Neighbours
+    {
+    public:
+        std::vector<real> x;
+        std::vector<real> y;
+        std::vector<uint32_t> index;    // position in the population
+
+        // scratch space for the candidates that survive the range filter
+        std::vector<uint32_t> keep;
+        std::vector<real> dx;
+        std::vector<real> dy;
+
+        void clear() { x.clear(); y.clear(); index.clear(); }
+        std::size_t size() const { return index.size(); }
+        void push_back(real _x, real _y, uint32_t i)
+        {
+            x.push_back(_x);
+            y.push_back(_y);
+            index.push_back(i);
+        }
+    };
+
     // utilities
 
     /** Normalize a length to within 0 to worldsize. */
-    inline double DistanceNormalize(double d)
+    inline real DistanceNormalize(real d)
     {
         while(d < 0)
             d += worldsize;
@@ -103,7 +386,7 @@ namespace Uni
     }
 
     /** Normalize an angle to within +/_ M_PI. */
-    inline double AngleNormalize(double a)
+    inline real AngleNormalize(real a)
     {
         while( a < -M_PI )
             a += 2.0 * M_PI;
@@ -118,13 +401,27 @@ namespace Uni
     /** Convert degrees to radians */
     inline double dtor(double d) { return( d * M_PI / 180.0 ); }
 
-    inline void RandomPose(double pose[3])
+    inline void RandomPose(real pose[3])
     {
         pose[0] = drand48() * worldsize;
         pose[1] = drand48() * worldsize;
         pose[2] = AngleNormalize(drand48() * (M_PI*2.0));
     }
 
+    /** A random pose for robot id that only depends on the seed, drawn
+        from its RobotRandom for the step before the first. */
+    inline void RandomPose(real pose[3], uint64_t id)
+    {
+        RobotRandom random(id, 0xffffffffU);
+        pose[0] = random.Uniform() * worldsize;
+        pose[1] = random.Uniform() * worldsize;
+        pose[2] = AngleNormalize(random.Uniform() * (M_PI*2.0));
+    }
+
+    /** Give every robot of the population its RandomPose(pose, id), on
+        all of the threads. */
+    void RandomPoses();
+
 }; // namespace Uni
 
 #endif // UNIVERSE_H
@@ -0,0 +1,165 @@
+/****
+         viewer.cc
+         GLUT front-end that draws the robots while the simulation runs.
+
+         part of universe (https://github.com/antsam/universe)
+****/
+
+#include <unistd.h>
+#include "universe.h"
+
+#ifdef __APPLE__
+    #include <glut/glut.h>
+#else
+    #include <GL/glut.h> // OS X users need <glut/glut.h> instead
+#endif
+
+using namespace Uni;
+
+const char* PROGNAME = "universe";
+
+static int displaylist(0);
+
+// GLUT callback functions ---------------------------------------------------
+
+// update the world - this is called whenever GLUT runs out of events
+// to process
+static void idle_func()
+{
+    Uni::UpdateAll();
+    // possibly snooze to save CPU and slow things down
+    if(Uni::sleep_msec > 0)
+        usleep(Uni::sleep_msec * 1e3);
+}
+
+static void timer_func(int dummy)
+{
+    glutPostRedisplay(); // force redraw
+}
+
+// draw the world - this is called whenever the window needs redrawn
+static void display_func()
+{
+    if(Uni::need_redraw)
+    {
+        Uni::need_redraw = false;
+
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        FOR_EACH(r, population)
+        {
+            r->Draw();
+        }
+
+        glutSwapBuffers();
+
+        glFlush();
+    }
+
+    // cause this run again in about 50 msec
+    glutTimerFunc(50, timer_func, 0);
+}
+
+static void mouse_func(int button, int state, int x, int y)
+{
+    if((button == GLUT_LEFT_BUTTON) && (state == GLUT_DOWN))
+    {
+        Uni::paused = !Uni::paused;
+    }
+}
+
+// set up the window and the display list for a robot body
+static void init_graphics(int argc, char** argv)
+{
+    // initialize opengl graphics
+    glutInit(&argc, argv);
+    glutInitWindowSize(winsize, winsize);
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA);
+    glutCreateWindow(PROGNAME);
+    glClearColor(0.8, 0.8, 1.0, 1.0);
+    glutDisplayFunc(display_func);
+    glutTimerFunc(50, timer_func, 0);
+    glutMouseFunc(mouse_func);
+    glutIdleFunc(idle_func);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_BLEND);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluOrtho2D(0, 1, 0, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glScalef(1.0/worldsize, 1.0/worldsize, 1);
+
+    // define a display list for a robot body
+    double h = 0.01;
+    double w = 0.01;
+
+    glPointSize( 4.0 );
+
+    displaylist = glGenLists(1);
+    glNewList(displaylist, GL_COMPILE);
+
+    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+
+    glBegin(GL_POLYGON);
+    glVertex2f(h/2.0, 0);
+    glVertex2f(-h/2.0, w/2.0);
+    glVertex2f(-h/2.0, -w/2.0);
+    glEnd();
+
+    glEndList();
+}
+
+// GLUT calls idle_func() for every step
+static void run_graphics()
+{
+    glutMainLoop();
+}
+
+static const FrontEnd viewer = { init_graphics, run_graphics };
+
+// install the viewer before main() runs, so linking this file in is enough
+static const bool installed = (SetFrontEnd(&viewer), true);
+
+// draw a robot
+void Robot::Draw() const
+{
+    glPushMatrix();
+    glTranslatef(pose[0], pose[1], 0);
+    glRotatef(rtod(pose[2]), 0, 0, 1);
+
+    glColor3ub(color[0], color[1], color[2]);
+
+    // draw the pre-compiled triangle for a body
+    glCallList(displaylist);
+
+    if(show_data)
+    {
+        // render the sensors
+        double rads_per_pixel = fov / (double)pixel_count;
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+        double angle, dx1, dy1, dx2, dy2;
+        double half_rads_per_pixel = (rads_per_pixel/2.0);
+        unsigned int p = 0;
+
+        for(; p < pixel_count; ++p)
+        {
+            angle = -fov/2.0 + (p+0.5) * rads_per_pixel;
+            dx1 = pixels[p].range * cos(angle + half_rads_per_pixel);
+            dy1 = pixels[p].range * sin(angle + half_rads_per_pixel);
+            dx2 = pixels[p].range * cos(angle - half_rads_per_pixel);
+            dy2 = pixels[p].range * sin(angle - half_rads_per_pixel);
+
+            glColor4f( 1,0,0, (pixels[p].robot != Pixel::NONE) ? 0.2 : 0.05 );
+
+            glBegin(GL_POLYGON);
+            glVertex2f(0, 0);
+            glVertex2f(dx1, dy1);
+            glVertex2f(dx2, dy2);
+            glEnd();
+        }
+    }
+
+    glPopMatrix();
+}
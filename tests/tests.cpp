@@ -8,17 +8,167 @@
 // Created: January 17, 2013
 // ---------------------------------------------------------------------------
 #include "src/QuadTree.h"
+#include "src/SpatialGrid.h"
+#include "src/ThreadPool.h"
+#include "src/checkpoint.h"
+#include "src/domain.h"
+#include "src/kernels.h"
+#include "src/random.h"
+#include "src/shared.h"
+#include "src/stats.h"
+#include "src/swarm.h"
+#include "src/trajectory.h"
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <iostream>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #define VAR(V,init) __typeof(init) V=(init)
 #define FOR_EACH(I,C) for(VAR(I,(C).begin());I!=(C).end();I++)
 
+// counts the hits of a QuadTree query
+struct CountingVisitor
+{
+    std::size_t hits;
+    CountingVisitor() : hits(0) {}
+    void operator()(const Anton::leaf &l) { ++hits; }
+};
+
+// marks every item of a parallel_for, remembering which worker got it
+static void mark_items(std::size_t begin, std::size_t end, std::size_t worker, void *data)
+{
+    std::vector<std::size_t> &marks = *static_cast<std::vector<std::size_t> *>(data);
+
+    for(; begin < end; ++begin)
+    {
+        marks[begin] += worker + 1;
+    }
+}
+
 /**
  * Generally I would use a testing framework for this but I don't know if we can install
  * libraries in CSIL properly.
  */
 
+// one rank's side of an exchange, on a thread of its own
+struct ExchangeJob
+{
+    Uni::Domain domain;
+    std::vector<Uni::Robot> robots;
+    std::size_t owned;
+};
+
+static void *exchange_robots(void *data)
+{
+    ExchangeJob &job = *static_cast<ExchangeJob *>(data);
+    job.owned = job.domain.Exchange(job.robots, job.owned, Uni::Robot::range);
+    return NULL;
+}
+
+// the x of every robot, sorted, for comparing ranks
+static std::vector<Uni::real> xs_of(const std::vector<Uni::Robot> &robots, std::size_t first, std::size_t last)
+{
+    std::vector<Uni::real> xs;
+    for(; first < last; ++first)
+    {
+        xs.push_back(robots[first].pose[0]);
+    }
+    std::sort(xs.begin(), xs.end());
+    return xs;
+}
+
+// turns harder the more the closest robot faces the same way, and against
+// its turn. Every step depends on the pose and speed of the robots seen,
+// which the callbacks of the others change.
+static void steer_by_sight(Uni::Robot &r, void *user)
+{
+    const Uni::Robot::Pixel *closest = NULL;
+
+    FOR_EACH(p, r.pixels)
+    {
+        if((closest == NULL) || (p->range < closest->range))
+        {
+            closest = p;
+        }
+    }
+
+    const Uni::Robot *seen = (closest != NULL) ? closest->Seen() : NULL;
+    r.speed[0] = 0.005;
+    r.speed[1] = (seen != NULL) ? ((0.05 * cos(seen->pose[2] - r.pose[2])) - (0.5 * seen->speed[1])) : 0;
+}
+
+// steps the whole simulation in a child process with options, and returns
+// the final poses of the robots in population order
+static std::vector<Uni::real> poses_after(const char *options[], const std::size_t &steps)
+{
+    int out[2];
+    assert(pipe(out) == 0);
+    std::cout << std::flush; // or the child writes it again
+
+    pid_t child = fork();
+    assert(child >= 0);
+    if(child == 0)
+    {
+        std::vector<char *> argv(1, (char *)"tests");
+        for(; *options != NULL; ++options)
+        {
+            argv.push_back((char *)*options);
+        }
+        argv.push_back(NULL);
+        optind = 1;
+
+        close(out[0]);
+        assert(freopen("/dev/null", "w", stdout) != NULL); // the FPS counter
+        Uni::Init(argv.size() - 1, &argv[0]);
+        Uni::RandomPoses();
+        FOR_EACH(r, Uni::population)
+        {
+            r->callback = steer_by_sight;
+            r->callback_data = NULL;
+        }
+        Uni::Start();
+
+        std::size_t step = 0, i;
+        for(; step < steps; ++step)
+        {
+            Uni::UpdateAll();
+        }
+
+        // the other processes of --shm finish their last step first
+        if(Uni::shared.rank != 0)
+        {
+            _exit(0);
+        }
+        Uni::shared.Wait();
+
+        for(i = 0; i < Uni::population.size(); ++i)
+        {
+            const std::size_t k = Uni::bodies.slot[i];
+            Uni::real pose[3] = { Uni::bodies.x[k], Uni::bodies.y[k], Uni::bodies.a[k] };
+            write(out[1], pose, sizeof(pose));
+        }
+        _exit(0); // without the parent's atexit() handlers
+    }
+
+    close(out[1]);
+    std::vector<Uni::real> poses;
+    Uni::real pose[3];
+    while(read(out[0], pose, sizeof(pose)) == (ssize_t)sizeof(pose))
+    {
+        poses.insert(poses.end(), pose, pose + 3);
+    }
+    close(out[0]);
+
+    int status;
+    assert(waitpid(child, &status, 0) == child);
+    assert(WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+    return poses;
+}
+
 int main()
 {
     /**
@@ -264,6 +414,285 @@ int main()
     assert(found.empty());
     std::cout << "PASSED" << std::endl;
 
+    // testing the output buffer and visitor queries
+    Anton::box near_zero(0, 0, 2 * Uni::Robot::range, 2 * Uni::Robot::range);
+    std::vector<Uni::Robot *> buffer(1, NULL);
+
+    std::cout << "Testing if found robots are appended to a buffer.  ";
+    tree->find_in_range(near_zero, buffer);
+    assert(buffer.size() == 2);
+    assert(buffer[0] == NULL);
+    assert(buffer[1] == tree->find_in_range(0, 0)[0]);
+    std::cout << "PASSED" << std::endl;
+
+    CountingVisitor counter;
+
+    std::cout << "Testing if a visitor sees every found robot.       ";
+    tree->visit_leaves_at(Anton::box(xs[13]/600.0f, ys[13]/600.0f, 2 * Uni::Robot::range, 2 * Uni::Robot::range), counter);
+    assert(counter.hits == 3);
+    tree->visit_in_range(near_zero, counter);
+    assert(counter.hits == 4);
+    std::cout << "PASSED" << std::endl;
+
+    // testing that flush() keeps the node pool for the next rebuild
+    std::size_t node_count = tree->get_node_count();
+    std::size_t rebuilds = 0;
+
+    std::cout << "Testing if rebuilding after flush reuses the nodes. ";
+    for(; rebuilds < 3; ++rebuilds)
+    {
+        tree->flush();
+        assert(tree->get_node_count() == 1);
+
+        FOR_EACH(it, population)
+        {
+            assert(tree->add_leaf(&(*it)));
+        }
+
+        assert(tree->get_node_count() == node_count);
+    }
+    std::cout << "PASSED" << std::endl;
+
+    std::cout << "Testing if 3 robots still found in (" << xs[13] << "," << ys[13] << ").   ";
+    found.clear();
+    found = tree->get_leaves_at(xs[13]/600.0f, ys[13]/600.0f);
+    assert(found.size() == 3);
+    std::cout << "PASSED" << std::endl;
+
+    // testing a tree that is kept between steps against one that is rebuilt
+    std::vector<Uni::Robot> walkers(500);
+    Anton::QuadTree *kept = new Anton::QuadTree(canvas, max_leaves);
+    Anton::QuadTree *rebuilt = new Anton::QuadTree(canvas, max_leaves);
+    uint32_t handle = 0;
+
+    srand48(1);
+    for(; handle < walkers.size(); ++handle)
+    {
+        walkers[handle].pose[0] = 0.4 + (0.2 * drand48());
+        walkers[handle].pose[1] = 0.4 + (0.2 * drand48());
+        assert(kept->insert_leaf(handle, &walkers[handle], walkers[handle].pose[0], walkers[handle].pose[1]));
+    }
+
+    std::cout << "Testing if moved robots are found like rebuilt ones. ";
+    for(rebuilds = 0; rebuilds < 20; ++rebuilds)
+    {
+        // spread out from the middle
+        for(handle = 0; handle < walkers.size(); ++handle)
+        {
+            Uni::Robot &w = walkers[handle];
+            w.pose[0] = std::min(0.999, std::max(0.001, w.pose[0] + (0.04 * (drand48() - 0.5))));
+            w.pose[1] = std::min(0.999, std::max(0.001, w.pose[1] + (0.04 * (drand48() - 0.5))));
+            assert(kept->move_leaf(handle, w.pose[0], w.pose[1]));
+        }
+
+        rebuilt->flush();
+        FOR_EACH(it, walkers)
+        {
+            rebuilt->add_leaf(&(*it));
+        }
+
+        for(handle = 0; handle < walkers.size(); handle += 25)
+        {
+            std::vector<Uni::Robot *> from_kept = kept->find_in_range(walkers[handle].pose[0], walkers[handle].pose[1]);
+            std::vector<Uni::Robot *> from_rebuilt = rebuilt->find_in_range(walkers[handle].pose[0], walkers[handle].pose[1]);
+            std::sort(from_kept.begin(), from_kept.end());
+            std::sort(from_rebuilt.begin(), from_rebuilt.end());
+            assert(from_kept == from_rebuilt);
+        }
+    }
+    assert(kept->get_moved_count() > 0);
+    std::cout << "PASSED" << std::endl;
+
+    std::cout << "Testing if removing robots merges the nodes.       ";
+    assert(kept->get_node_count() > 1);
+    for(handle = 0; handle < walkers.size(); ++handle)
+    {
+        kept->remove_leaf(handle);
+    }
+    assert(kept->get_node_count() == 1);
+    assert(kept->find_in_range(0.5, 0.5).empty());
+    std::cout << "PASSED" << std::endl;
+
+    std::cout << "Testing if absent robots leave the tree alone.     ";
+    const Anton::box whole_world(0.5, 0.5, 2, 2);
+    kept->remove_leaf(0); // a second time
+    assert(kept->get_node_count() == 1);
+    assert(kept->move_leaf(0, 0.5, 0.5)); // after being removed
+    assert(kept->find_in_range(whole_world).size() == 1);
+    kept->remove_leaf(0);
+    assert(!kept->move_leaf(walkers.size(), 0.5, 0.5)); // never inserted
+    for(handle = 0; handle < walkers.size(); ++handle)
+    {
+        assert(kept->move_leaf(handle, walkers[handle].pose[0], walkers[handle].pose[1]));
+    }
+    assert(!kept->move_leaf(7, 1.5, 0.5)); // out of the world
+    kept->remove_leaf(7);
+    assert(!kept->move_leaf(7, 1.5, 0.5));
+    std::vector<Uni::Robot *> left = kept->find_in_range(whole_world);
+    std::sort(left.begin(), left.end());
+    assert(left.size() == (walkers.size() - 1));
+    assert(std::unique(left.begin(), left.end()) == left.end());
+    assert(!std::binary_search(left.begin(), left.end(), &walkers[7]));
+    assert(kept->move_leaf(7, walkers[7].pose[0], walkers[7].pose[1])); // back in
+    assert(kept->find_in_range(whole_world).size() == walkers.size());
+    std::cout << "PASSED" << std::endl;
+
+    // testing the parallel build against adding robots one by one. Half of
+    // the robots are bunched up so the subtrees differ in size, and a few
+    // are outside the world.
+    std::cout << "Testing if a parallel build matches adding in order. ";
+    std::vector<Uni::Robot> crowd(20000);
+    std::vector<Uni::real> crowd_x(crowd.size()), crowd_y(crowd.size());
+    std::vector<uint32_t> crowd_ids(crowd.size());
+    unsigned short crowd_seed[3] = { 1, 2, 3 }; // leaves drand48() to the tests below
+    Anton::ThreadPool builders(4);
+    for(i = 0; i < crowd.size(); ++i)
+    {
+        bool bunched = (i % 2) == 0;
+        crowd_x[i] = bunched ? (0.1 + (0.05 * erand48(crowd_seed))) : erand48(crowd_seed);
+        crowd_y[i] = bunched ? (0.7 + (0.05 * erand48(crowd_seed))) : erand48(crowd_seed);
+        if((i % 1000) == 999)
+        {
+            crowd_x[i] = 1.5;
+        }
+        crowd_ids[i] = crowd.size() - 1 - i;
+    }
+
+    rebuilt->flush();
+    for(i = 0; i < crowd.size(); ++i)
+    {
+        rebuilt->add_leaf(&crowd[crowd_ids[i]], crowd_x[i], crowd_y[i]);
+    }
+    for(rebuilds = 0; rebuilds < 2; ++rebuilds)
+    {
+        // the second build reuses the pool of the first
+        kept->build(&crowd_x[0], &crowd_y[0], &crowd[0], &crowd_ids[0], crowd.size(), builders);
+        assert(kept->get_node_count() == rebuilt->get_node_count());
+        for(i = 0; i < crowd.size(); i += 97)
+        {
+            assert(kept->find_in_range(crowd_x[i], crowd_y[i]) == rebuilt->find_in_range(crowd_x[i], crowd_y[i]));
+        }
+    }
+    assert(kept->find_in_range(Anton::box(0.5, 0.5, 2, 2)).size() == (crowd.size() - 20));
+    std::cout << "PASSED" << std::endl;
+
+    delete rebuilt;
+    delete kept;
+
+    // testing a world bigger than the unit square
+    Anton::QuadTree *big = new Anton::QuadTree(Anton::box(5, 5, 10, 10), max_leaves);
+    std::vector<Uni::Robot> corners(200);
+
+    std::cout << "Testing if robots on the edges of the world fit.   ";
+    for(i = 0; i < corners.size(); ++i)
+    {
+        // near every corner, and a few right on the edges
+        corners[i].pose[0] = (i & 1) ? (10 - (0.05 * drand48())) : (0.05 * drand48());
+        corners[i].pose[1] = (i & 2) ? (10 - (0.05 * drand48())) : (0.05 * drand48());
+        if(i < 4)
+        {
+            corners[i].pose[0] = (i & 1) ? 10 : 0;
+        }
+        assert(big->add_leaf(&corners[i]));
+    }
+    std::cout << "PASSED" << std::endl;
+
+    std::cout << "Testing if wrapped queries find each robot once.   ";
+    found.clear();
+    big->find_in_range(Anton::box(0.01, 9.99, 0.2, 0.2), found);
+    assert(found.size() == corners.size());
+    std::sort(found.begin(), found.end());
+    assert(std::unique(found.begin(), found.end()) == found.end());
+    found.clear();
+    big->find_in_range(Anton::box(5, 5, 30, 0.2), found);
+    assert(found.empty());
+    big->find_in_range(Anton::box(5, 0, 30, 0.2), found);
+    assert(found.size() == corners.size());
+    std::cout << "PASSED" << std::endl;
+
+    delete big;
+
+    // testing the grid finds everything the tree does
+    Anton::SpatialGrid *index = new Anton::SpatialGrid(1.0f, Uni::Robot::range);
+    index->build(population);
+
+    std::cout << std::endl << "Grid set up with " << index->get_cells_per_side() << "x" << index->get_cells_per_side() << " cells." << std::endl;
+
+    std::cout << "Testing if the grid holds every robot once.        ";
+    CountingVisitor everything;
+    Anton::SpatialGrid *coarse = new Anton::SpatialGrid(1.0f, 0.5f);
+    coarse->build(population);
+    coarse->visit_in_range(0.5f, 0.5f, everything);
+    assert(coarse->get_cells_per_side() == 2);
+    assert(everything.hits == population.size());
+    delete coarse;
+    std::cout << "PASSED" << std::endl;
+
+    std::cout << "Testing if the grid finds all robots near robots.  ";
+    FOR_EACH(it, population)
+    {
+        std::vector<Uni::Robot *> from_tree = tree->find_in_range(it->pose[0], it->pose[1]);
+        std::vector<Uni::Robot *> from_grid;
+        index->find_in_range(it->pose[0], it->pose[1], from_grid);
+
+        FOR_EACH(r, from_tree)
+        {
+            assert(std::find(from_grid.begin(), from_grid.end(), *r) != from_grid.end());
+        }
+    }
+    std::cout << "PASSED" << std::endl;
+
+    std::cout << "Testing if the grid wraps around the torus.        ";
+    found.clear();
+    index->find_in_range(0, 0, found);
+    assert(std::find(found.begin(), found.end(), &population[23]) != found.end());
+    std::cout << "PASSED" << std::endl;
+
+    // testing a grid built by several processes in shared memory, one
+    // grid object standing in for each of them
+    std::cout << "Testing if a grid built in slices matches build(). ";
+    const std::size_t slice_ranks = 3;
+    std::vector<Uni::real> pxs, pys;
+    FOR_EACH(it, population)
+    {
+        pxs.push_back(it->pose[0]);
+        pys.push_back(it->pose[1]);
+    }
+    std::vector<Anton::SpatialGrid *> slices;
+    for(i = 0; i < slice_ranks; ++i)
+    {
+        slices.push_back(new Anton::SpatialGrid(1.0f, Uni::Robot::range));
+    }
+    std::vector<uint64_t> segment((slices[0]->shared_bytes(population.size(), slice_ranks) / sizeof(uint64_t)) + 1);
+    for(i = 0; i < slice_ranks; ++i)
+    {
+        slices[i]->place(population.size(), slice_ranks, &segment[0]);
+        slices[i]->count_slice(&pxs[0], &pys[0], (population.size() * i) / slice_ranks, (population.size() * (i + 1)) / slice_ranks, i);
+    }
+    for(i = 0; i < slice_ranks; ++i)
+    {
+        slices[i]->fill_slice(&pxs[0], &pys[0], &population[0], NULL, (population.size() * i) / slice_ranks, (population.size() * (i + 1)) / slice_ranks, i);
+    }
+    FOR_EACH(it, population)
+    {
+        std::vector<Uni::Robot *> whole, sliced;
+        index->find_in_range(it->pose[0], it->pose[1], whole);
+        for(i = 0; i < slice_ranks; ++i)
+        {
+            slices[i]->find_in_range(it->pose[0], it->pose[1], sliced);
+            assert(sliced == whole);
+            sliced.clear();
+        }
+    }
+    FOR_EACH(it, slices)
+    {
+        delete *it;
+    }
+    std::cout << "PASSED" << std::endl;
+
+    delete index;
+    index = NULL;
+
     tree->clear();
 
     delete tree;
@@ -272,6 +701,644 @@ int main()
     xs.clear();
     ys.clear();
 
+    // testing the structure-of-arrays state moves robots the same way they move themselves
+    std::cout << std::endl << "Testing if Bodies::UpdatePose matches Robot.      ";
+    Uni::Bodies bodies;
+    i = 0;
+    FOR_EACH(it, population)
+    {
+        it->speed[0] = 0.005 * i;
+        it->speed[1] = 0.04 * i++;
+    }
+    bodies.Load(population);
+    assert(bodies.Size() == population.size());
+    assert(((uintptr_t)bodies.x % 64) == 0);
+    for(i = 0; i < population.size(); ++i)
+    {
+        Uni::Robot moved = population[i];
+        moved.UpdatePose();
+        bodies.UpdatePose(i);
+        bodies.Store(i, population[i]);
+        assert(population[i].pose[0] == moved.pose[0]);
+        assert(population[i].pose[1] == moved.pose[1]);
+        assert(population[i].pose[2] == moved.pose[2]);
+    }
+    std::cout << "PASSED" << std::endl;
+
+    // testing the -D pose pass moves robots into a second copy
+    std::cout << "Testing if Bodies::MoveInto matches UpdatePose.    ";
+    Uni::Bodies next;
+    bodies.Load(population);
+    bodies.SortByMorton(1.0);
+    next.Allocate(bodies.Size());
+    for(i = 0; i < population.size(); ++i)
+    {
+        bodies.MoveInto(i, next);
+    }
+    for(i = 0; i < population.size(); ++i)
+    {
+        bodies.UpdatePose(i);
+        assert((next.x[i] == bodies.x[i]) && (next.y[i] == bodies.y[i]) && (next.a[i] == bodies.a[i]));
+        assert((next.v[i] == bodies.v[i]) && (next.w[i] == bodies.w[i]));
+        assert((next.id[i] == bodies.id[i]) && (next.slot[next.id[i]] == i));
+    }
+    const Uni::real *next_x = next.x;
+    bodies.Swap(next);
+    assert((bodies.x == next_x) && (bodies.Size() == population.size()));
+    std::cout << "PASSED" << std::endl;
+
+    // testing the Morton sort keeps every robot with its own state
+    std::cout << "Testing if sorting the bodies keeps their robots.  ";
+    bodies.Load(population);
+    bodies.SortByMorton(1.0);
+    for(i = 0; i < population.size(); ++i)
+    {
+        const Uni::Robot &r = population[bodies.id[i]];
+        assert(bodies.x[i] == r.pose[0]);
+        assert(bodies.y[i] == r.pose[1]);
+        assert(bodies.a[i] == r.pose[2]);
+        assert(bodies.v[i] == r.speed[0]);
+        assert(bodies.w[i] == r.speed[1]);
+    }
+    std::cout << "PASSED" << std::endl;
+
+    std::cout << "Testing if sorted bodies are in Z-order.           ";
+    for(i = 1; i < population.size(); ++i)
+    {
+        // in Z-order, a later robot is never both left of and below an earlier one
+        assert(!((bodies.x[i] < bodies.x[i - 1]) && (bodies.y[i] < bodies.y[i - 1])
+                 && (floor(bodies.x[i] * 2) != floor(bodies.x[i - 1] * 2))
+                 && (floor(bodies.y[i] * 2) != floor(bodies.y[i - 1] * 2))));
+    }
+    std::vector<uint32_t> ids(bodies.id, bodies.id + population.size());
+    std::sort(ids.begin(), ids.end());
+    for(i = 0; i < ids.size(); ++i)
+    {
+        assert(ids[i] == i);
+        assert(bodies.id[bodies.slot[i]] == i);
+    }
+    std::cout << "PASSED" << std::endl;
+
+    // testing bodies kept in memory owned by someone else, as with --shm
+    std::cout << "Testing if placed bodies stay where they are put.  ";
+    std::vector<Uni::real> outside((Uni::Bodies::Bytes(population.size()) / sizeof(Uni::real)) + 16);
+    Uni::real *memory = &outside[0];
+    while(((uintptr_t)memory % 64) != 0)
+    {
+        ++memory;
+    }
+    Uni::Bodies placed;
+    placed.Place(population.size(), memory);
+    placed.Load(population);
+    assert(placed.x == memory);
+    assert((char *)(placed.slot + population.size()) <= (char *)memory + Uni::Bodies::Bytes(population.size()));
+    assert(placed.y[population.size() - 1] == population.back().pose[1]);
+    std::cout << "PASSED" << std::endl;
+
+    // testing a checkpoint brings back sorted bodies and their robots
+    std::cout << "Testing if a checkpoint restores every robot.      ";
+    char checkpoint[] = "/tmp/universe-tests-XXXXXX";
+    close(mkstemp(checkpoint));
+    population.back().color[2] = 200;
+    bodies.Load(population);
+    bodies.SortByMorton(1.0);
+    Uni::random_seed = 0x123456789abcULL; // as with --seed
+    const uint32_t robot_draw = Uni::RobotRandom(7, 1234).Next();
+    assert(Uni::SaveCheckpoint(checkpoint, bodies, population, 1234));
+    const double next_draw = drand48();
+    Uni::random_seed = 0;
+
+    std::size_t restored_count = 0;
+    Uni::real restored_worldsize = 0;
+    assert(Uni::ReadCheckpointSize(checkpoint, restored_count, restored_worldsize));
+    assert((restored_count == population.size()) && (restored_worldsize == Uni::worldsize));
+
+    Uni::Bodies restored_bodies;
+    std::vector<Uni::Robot> restored(restored_count);
+    uint64_t restored_updates = 0;
+    assert(Uni::LoadCheckpoint(checkpoint, restored_bodies, restored, restored_updates));
+    assert(restored_updates == 1234);
+    assert(Uni::random_seed == 0x123456789abcULL);
+    assert(Uni::RobotRandom(7, 1234).Next() == robot_draw);
+    assert(drand48() == next_draw);
+    Uni::random_seed = 0;
+    for(i = 0; i < population.size(); ++i)
+    {
+        assert(restored_bodies.id[i] == bodies.id[i]);
+        assert(memcmp(restored[i].pose, population[i].pose, sizeof(population[i].pose)) == 0);
+        assert(memcmp(restored[i].speed, population[i].speed, sizeof(population[i].speed)) == 0);
+        assert(memcmp(restored[i].color, population[i].color, sizeof(population[i].color)) == 0);
+    }
+    std::cout << "PASSED" << std::endl;
+
+    // testing other files are turned away as such, not as the wrong build's
+    std::cout << "Testing if other files are not called checkpoints. ";
+    std::vector<char> not_a_checkpoint(4096, 1);
+    FILE *other_file = fopen(checkpoint, "wb");
+    assert(fwrite(&not_a_checkpoint[0], 1, not_a_checkpoint.size(), other_file) == not_a_checkpoint.size());
+    fclose(other_file);
+    FILE *complaints = tmpfile();
+    int saved_stderr = dup(STDERR_FILENO);
+    fflush(stderr);
+    dup2(fileno(complaints), STDERR_FILENO);
+    assert(!Uni::ReadCheckpointSize(checkpoint, restored_count, restored_worldsize));
+    fflush(stderr);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+    char complaint[256] = { 0 };
+    rewind(complaints);
+    assert(fgets(complaint, sizeof(complaint), complaints) != NULL);
+    assert(strstr(complaint, "is not a checkpoint.") != NULL);
+    fclose(complaints);
+    unlink(checkpoint);
+    std::cout << "PASSED" << std::endl;
+
+    // testing the trajectory format gives back what went in, to within
+    // its quantization
+    std::cout << "Testing if LZ compression round trips.             ";
+    std::vector<uint8_t> text, packed, unpacked;
+    for(i = 0; i < 5000; ++i)
+    {
+        text.push_back((i % 7 == 0) ? (uint8_t)(lrand48() & 0xff) : (uint8_t)(i % 13));
+    }
+    Uni::LzCompress(&text[0], text.size(), packed);
+    assert(packed.size() < text.size());
+    assert(Uni::LzDecompress(&packed[0], packed.size(), unpacked));
+    assert(unpacked == text);
+    assert(!Uni::LzDecompress(&packed[0], packed.size() / 2, unpacked));
+    std::cout << "PASSED" << std::endl;
+
+    std::cout << "Testing if a trajectory reads back every frame.    ";
+    char trajectory_path[] = "/tmp/universe-tests-XXXXXX";
+    close(mkstemp(trajectory_path));
+    Uni::TrajectoryWriter writer;
+    assert(writer.Open(trajectory_path, population.size(), 1.0, true, false));
+    for(std::size_t frame = 0; frame < 70; ++frame)
+    {
+        for(i = 0; i < population.size(); ++i)
+        {
+            bodies.UpdatePose(i);
+        }
+        writer.Record(bodies, frame * 3);
+    }
+    writer.Close();
+    assert(writer.Frames() == 70);
+
+    Uni::TrajectoryReader reader;
+    std::vector<double> read_x, read_y, read_a;
+    uint64_t read_update;
+    assert(reader.Open(trajectory_path));
+    assert((reader.Robots() == population.size()) && (reader.WorldSize() == 1.0));
+    for(std::size_t frame = 0; frame < 70; ++frame)
+    {
+        assert(reader.Next(read_update, read_x, read_y, read_a));
+        assert(read_update == (frame * 3));
+    }
+    assert(!reader.Next(read_update, read_x, read_y, read_a));
+    for(i = 0; i < population.size(); ++i)
+    {
+        std::size_t k = bodies.slot[i];
+        assert(fabs(read_x[i] - bodies.x[k]) <= (1.0 / 65536));
+        assert(fabs(read_y[i] - bodies.y[k]) <= (1.0 / 65536));
+        assert(fabs(read_a[i] - bodies.a[k]) <= ((2 * M_PI) / 65536));
+    }
+    assert(reader.Quantum() == (1.0 / 65536));
+    unlink(trajectory_path);
+    std::cout << "PASSED" << std::endl;
+
+    std::cout << "Testing if an exact trajectory keeps every bit.    ";
+    Uni::TrajectoryWriter exact_writer;
+    assert(exact_writer.Open(trajectory_path, population.size(), 1.0, true, true));
+    for(std::size_t frame = 0; frame < 3; ++frame)
+    {
+        for(i = 0; i < population.size(); ++i)
+        {
+            bodies.UpdatePose(i);
+        }
+        exact_writer.Record(bodies, frame);
+    }
+    exact_writer.Close();
+
+    Uni::TrajectoryReader exact_reader;
+    assert(exact_reader.Open(trajectory_path));
+    assert(exact_reader.Quantum() == 0);
+    for(std::size_t frame = 0; frame < 3; ++frame)
+    {
+        assert(exact_reader.Next(read_update, read_x, read_y, read_a));
+        assert(read_update == frame);
+    }
+    assert(!exact_reader.Next(read_update, read_x, read_y, read_a));
+    for(i = 0; i < population.size(); ++i)
+    {
+        std::size_t k = bodies.slot[i];
+        assert((read_x[i] == bodies.x[k]) && (read_y[i] == bodies.y[k]) && (read_a[i] == bodies.a[k]));
+    }
+    unlink(trajectory_path);
+    std::cout << "PASSED" << std::endl;
+
+    // testing when neighbour lists go out of date
+    Uni::NeighbourLists lists;
+    Uni::Neighbours nearby;
+    lists.Setup(2, 0.05);
+
+    std::cout << "Testing if neighbour lists expire with movement.   ";
+    assert(lists.CountStale() == 2);
+    nearby.push_back(0.5, 0.5, 0);
+    nearby.push_back(0.5 + Uni::Robot::range + 0.04, 0.5, 1);
+    nearby.push_back(0.5 + Uni::Robot::range + 0.06, 0.5, 1);
+    lists.Keep(0, 0.5, 0.5, nearby);
+    assert(!lists.Stale(0) && lists.Stale(1));
+    assert(lists.queries == 1);
+    lists.Moved(0, 0.02);
+    lists.Advance(0.02);
+    assert(!lists.Stale(0));
+    lists.Moved(0, 0.01);
+    lists.Advance(0.01);
+    assert(lists.Stale(0));
+    lists.Keep(0, 0.5, 0.5, nearby);
+    lists.Keep(1, 0.5, 0.5, nearby);
+    lists.Moved(0, 0.02);
+    lists.Advance(0.02);
+    assert(!lists.AnyStale(std::max(lists.Slack(0), lists.Slack(1))) && (lists.CountStale() == 0));
+    lists.Moved(1, 0.012);
+    lists.Advance(0.012);
+    assert(lists.AnyStale(std::max(lists.Slack(0), lists.Slack(1))) && (lists.CountStale() == 1));
+    lists.Invalidate();
+    assert(lists.CountStale() == 2);
+    std::cout << "PASSED" << std::endl;
+
+    // testing the vectorized range filters against the scalar one
+    const char *kernels[] = { "avx512", "avx2", "scalar" };
+    const std::size_t candidate_count = 1003;
+    std::vector<Uni::real> cxs(candidate_count), cys(candidate_count);
+    std::vector<uint32_t> keep(candidate_count), expected_keep(candidate_count);
+    std::vector<Uni::real> dxs(candidate_count), dys(candidate_count);
+    std::vector<Uni::real> expected_dxs(candidate_count), expected_dys(candidate_count);
+
+    srand48(1);
+    for(i = 0; i < candidate_count; ++i)
+    {
+        cxs[i] = drand48();
+        cys[i] = drand48();
+    }
+
+    std::size_t expected_count = Uni::FilterInRangeScalar(&cxs[0], &cys[0], candidate_count, 0.02, 0.97, 1.0, 0.1,
+                                                          &expected_keep[0], &expected_dxs[0], &expected_dys[0]);
+
+    for(i = 0; i < 3; ++i)
+    {
+        if(!Uni::SelectFilterKernel(kernels[i]))
+        {
+            std::cout << "Skipping the " << kernels[i] << " range filter, not supported here." << std::endl;
+            continue;
+        }
+
+        std::cout << "Testing if the " << kernels[i] << " range filter matches scalar.";
+        std::cout << std::string(7 - strlen(kernels[i]), ' ');
+        std::size_t count = Uni::FilterInRange(&cxs[0], &cys[0], candidate_count, 0.02, 0.97, 1.0, 0.1,
+                                               &keep[0], &dxs[0], &dys[0]);
+        assert(count == expected_count);
+        assert(count > 0);
+        assert(count < candidate_count / 10);
+        for(std::size_t k = 0; k < count; ++k)
+        {
+            assert(keep[k] == expected_keep[k]);
+            assert(dxs[k] == expected_dxs[k]);
+            assert(dys[k] == expected_dys[k]);
+            assert(hypot(dxs[k], dys[k]) <= 0.1 * 1.001);
+        }
+        std::cout << "PASSED" << std::endl;
+    }
+
+    Uni::SelectFilterKernel(NULL);
+
+    // testing the sector table against atan2() binning
+    const double fovs[] = { Uni::dtor(90.0), Uni::dtor(270.0), Uni::dtor(360.0) };
+    const unsigned int pixel_counts[] = { 8, 64, 7 };
+    std::size_t f, c, directions;
+
+    std::cout << "Testing if sector binning matches atan2() binning.  ";
+    for(f = 0; f < 3; ++f)
+    {
+        for(c = 0; c < 3; ++c)
+        {
+            Uni::SectorTable sectors;
+            sectors.Setup(fovs[f], pixel_counts[c]);
+            double radians_per_pixel = fovs[f] / pixel_counts[c];
+
+            for(directions = 0; directions < 2000; ++directions)
+            {
+                double angle = (drand48() * 2.0 - 1.0) * M_PI;
+                double nearest = fabs(remainder(angle, radians_per_pixel));
+                if((nearest < 1e-9) || (fabs(fabs(angle) - fovs[f] / 2.0) < 1e-9))
+                {
+                    continue; // too close to a boundary to call
+                }
+
+                int pixel = -1;
+                bool seen = sectors.Bin(0.05 * cos(angle), 0.05 * sin(angle), pixel);
+                assert(seen == (fabs(angle) <= fovs[f] / 2.0));
+
+                if(seen)
+                {
+                    int expected = (int)floor(angle / radians_per_pixel) + (int)(pixel_counts[c] / 2);
+                    expected %= (int)pixel_counts[c];
+                    assert(pixel == expected);
+                }
+            }
+        }
+    }
+    std::cout << "PASSED" << std::endl;
+
+    // testing the thread pool
+    std::cout << "Testing if parallel_for visits every item once.   ";
+    Anton::ThreadPool *workers = new Anton::ThreadPool(4);
+    std::vector<std::size_t> marks(1000, 0);
+    assert(workers->get_thread_count() == 4);
+    workers->parallel_for(marks.size(), 7, mark_items, &marks);
+    workers->parallel_for(0, 7, mark_items, &marks);
+    FOR_EACH(it, marks)
+    {
+        assert((*it >= 1) && (*it <= 4));
+    }
+    delete workers;
+    std::cout << "PASSED" << std::endl;
+
+    // testing the step timing histograms
+    Uni::Histogram durations;
+    uint64_t ns = 1;
+
+    std::cout << "Testing if histogram percentiles are within 12.5%. ";
+    for(; ns <= 100000; ++ns)
+    {
+        durations.Add(ns);
+    }
+    assert(durations.Count() == 100000);
+    assert(durations.Total() == (100000ULL * 100001ULL) / 2);
+    assert((durations.Min() == 1) && (durations.Max() == 100000));
+    assert(fabs(durations.Percentile(50) - 50000.0) <= (0.125 * 50000));
+    assert(fabs(durations.Percentile(99) - 99000.0) <= (0.125 * 99000));
+    assert(durations.Percentile(100) == 100000);
+    assert(Uni::Histogram().Percentile(50) == 0);
+    std::cout << "PASSED" << std::endl;
+
+    // testing the exchange between the strips of a split world
+    std::cout << "Testing if robots cross between two ranks and are seen across both borders. ";
+    const Uni::real starts[2][3] = { { 0.25, 0.45, 0.55 }, { 0.75, 0.98, 0.02 } };
+    ExchangeJob jobs[2];
+    int links[2][2];
+    pthread_t threads[2];
+
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, links[0]) == 0);
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, links[1]) == 0);
+    jobs[0].domain.Connect(0, 2, links[1][1], links[0][0]);
+    jobs[1].domain.Connect(1, 2, links[0][1], links[1][0]);
+    for(i = 0; i < 2; ++i)
+    {
+        jobs[i].robots.resize(3);
+        for(std::size_t j = 0; j < 3; ++j)
+        {
+            jobs[i].robots[j].pose[0] = starts[i][j];
+            jobs[i].robots[j].pose[1] = 0.5;
+        }
+        jobs[i].owned = 3;
+        assert(pthread_create(&threads[i], NULL, exchange_robots, &jobs[i]) == 0);
+    }
+    pthread_join(threads[0], NULL);
+    pthread_join(threads[1], NULL);
+
+    // 0.55 and 0.02 changed hands, and everything within range of 0.0 or
+    // 0.5 is a ghost on the other side
+    const Uni::real owned_0[] = { 0.02, 0.25, 0.45 }, ghosts_0[] = { 0.55, 0.98 };
+    const Uni::real owned_1[] = { 0.55, 0.75, 0.98 }, ghosts_1[] = { 0.02, 0.45 };
+    assert((jobs[0].owned == 3) && (jobs[1].owned == 3));
+    assert(xs_of(jobs[0].robots, 0, 3) == std::vector<Uni::real>(owned_0, owned_0 + 3));
+    assert(xs_of(jobs[0].robots, 3, jobs[0].robots.size()) == std::vector<Uni::real>(ghosts_0, ghosts_0 + 2));
+    assert(xs_of(jobs[1].robots, 0, 3) == std::vector<Uni::real>(owned_1, owned_1 + 3));
+    assert(xs_of(jobs[1].robots, 3, jobs[1].robots.size()) == std::vector<Uni::real>(ghosts_1, ghosts_1 + 2));
+    assert(jobs[1].domain.RankOf(1.0) == 1);
+    std::cout << "PASSED" << std::endl;
+
+    // testing the counter-based random numbers against the Random123
+    // known-answer vectors
+    std::cout << "Testing if Philox4x32-10 gives the known answers.  ";
+    const uint32_t philox_in[3][6] = {
+        { 0, 0, 0, 0, 0, 0 },
+        { 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff },
+        { 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344, 0xa4093822, 0x299f31d0 } };
+    const uint32_t philox_out[3][4] = {
+        { 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 },
+        { 0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd },
+        { 0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 } };
+    for(i = 0; i < 3; ++i)
+    {
+        uint32_t words[4];
+        Uni::Philox(philox_in[i], philox_in[i] + 4, words);
+        assert(std::equal(words, words + 4, philox_out[i]));
+    }
+    std::cout << "PASSED" << std::endl;
+
+    std::cout << "Testing if robot random numbers ignore draw order. ";
+    Uni::RobotRandom later(7, 12, 3), earlier(7, 12, 3), other(7, 13, 3);
+    std::vector<uint32_t> draws;
+    for(i = 0; i < 9; ++i)
+        draws.push_back(later.Next());
+    assert(other.Next() != draws[0]);
+    for(i = 0; i < 9; ++i)
+        assert(earlier.Next() == draws[i]);
+    for(i = 0; i < 1000; ++i)
+    {
+        double u = later.Uniform();
+        assert((u >= 0) && (u < 1));
+    }
+
+    // the threads give every robot the pose it would get on its own
+    Uni::population.resize(10000);
+    Uni::RandomPoses();
+    for(i = 0; i < Uni::population.size(); ++i)
+    {
+        Uni::real pose[3];
+        Uni::RandomPose(pose, i);
+        assert(std::equal(pose, pose + 3, Uni::population[i].pose));
+    }
+    Uni::population.clear();
+    std::cout << "PASSED" << std::endl;
+
+    // testing that every robot gets its own part of the pixel arena
+    std::cout << "Testing if the pixel arena gives robots their own. ";
+    Uni::PixelArena arena;
+    std::vector<Uni::Robot> robots(3);
+    arena.Allocate(robots.size());
+    arena.Attach(robots, 0, robots.size());
+    Uni::PixelArena::Clear(arena.Data(), robots.size() * Uni::Robot::pixel_count);
+    for(i = 0; i < robots.size(); ++i)
+    {
+        assert(robots[i].pixels.size() == Uni::Robot::pixel_count);
+        assert(robots[i].pixels.begin() == arena.Data() + (i * Uni::Robot::pixel_count));
+        FOR_EACH(p, robots[i].pixels)
+        {
+            // nothing detected reads as no closer than the range
+            assert((p->range >= Uni::Robot::range) && (p->robot == Uni::Robot::Pixel::NONE));
+            assert(p->Seen() == NULL);
+        }
+    }
+    robots[1].pixels[0].range = 0;
+    assert((robots[0].pixels[0].range != 0) && (robots[2].pixels[0].range != 0));
+    std::cout << "PASSED" << std::endl;
+
+    // testing the demo batch controller against its per-robot callback, with
+    // and without a kernel for the pixel count
+    std::cout << "Testing if batches steer like per-robot callbacks. ";
+    const unsigned int steered_counts[] = { 7, 8, 16, 32, 64 };
+    const unsigned int pixel_count = Uni::Robot::pixel_count;
+    std::size_t turns[2] = { 0, 0 };
+    for(c = 0; c < 10; ++c)
+    {
+        Uni::Robot::pixel_count = steered_counts[c / 2];
+        invert = (c % 2) == 1;
+
+        std::vector<Uni::Robot> steered(300);
+        Uni::PixelArena steered_pixels;
+        steered_pixels.Allocate(steered.size());
+        steered_pixels.Attach(steered, 0, steered.size());
+        Uni::PixelArena::Clear(steered_pixels.Data(), steered.size() * Uni::Robot::pixel_count);
+        for(i = 0; i < (steered.size() * Uni::Robot::pixel_count); ++i)
+        {
+            if(drand48() < 0.1)
+            {
+                steered_pixels.Data()[i].range = drand48() * Uni::Robot::range;
+                steered_pixels.Data()[i].robot = 0;
+            }
+        }
+
+        std::vector<uint32_t> steered_ids(steered.size());
+        std::vector<Uni::real> zeros(steered.size(), 0), v(steered.size()), w(steered.size());
+        Uni::RobotBlock block;
+        block.first = 0;
+        block.count = steered.size();
+        block.pixel_count = Uni::Robot::pixel_count;
+        block.pixels = steered_pixels.Data();
+        block.id = &steered_ids[0];
+        block.x = block.y = block.a = &zeros[0];
+        block.v = &v[0];
+        block.w = &w[0];
+        BatchController(block, NULL);
+
+        for(i = 0; i < steered.size(); ++i)
+        {
+            Controller(steered[i], NULL);
+            assert((steered[i].speed[0] == v[i]) && (steered[i].speed[1] == w[i]));
+            turns[(w[i] > 0) ? 1 : 0] += (w[i] != 0) ? 1 : 0;
+        }
+    }
+    assert((turns[0] > 0) && (turns[1] > 0));
+    invert = false;
+    Uni::Robot::pixel_count = pixel_count;
+    std::cout << "PASSED" << std::endl;
+
+    // testing that -D gives the same bits whatever the number of threads
+    std::cout << "Testing if -D steps the same on 1 and 4 threads.  ";
+    const char *one_thread[] = { "-q", "-D", "-p", "2000", "-s", "1", "-r", "0.1", "-f", "90", "-c", "16", "-t", "1", NULL };
+    const char *four_threads[] = { "-q", "-D", "-p", "2000", "-s", "1", "-r", "0.1", "-f", "90", "-c", "16", "-t", "4", NULL };
+    std::vector<Uni::real> serial = poses_after(one_thread, 30);
+    std::vector<Uni::real> threaded = poses_after(four_threads, 30);
+    assert(serial.size() == (3 * 2000));
+    assert(memcmp(&serial[0], &threaded[0], serial.size() * sizeof(Uni::real)) == 0);
+    std::cout << "PASSED" << std::endl;
+
+    // testing processes sharing the population step it like one does
+    std::cout << "Testing if --shm steps the same as one process.   ";
+    const char *one_process[] = { "-q", "-D", "-g", "-p", "2000", "-s", "1", "-r", "0.1", "-f", "90", "-c", "16", NULL };
+    const char *three_processes[] = { "-q", "-D", "-g", "-p", "2000", "-s", "1", "-r", "0.1", "-f", "90", "-c", "16", "--shm", "3", NULL };
+    std::vector<Uni::real> alone = poses_after(one_process, 30);
+    std::vector<Uni::real> shared_poses = poses_after(three_processes, 30);
+    assert((alone.size() == (3 * 2000)) && (shared_poses.size() == alone.size()));
+    assert(memcmp(&alone[0], &shared_poses[0], alone.size() * sizeof(Uni::real)) == 0);
+    std::cout << "PASSED" << std::endl;
+
+    // testing a run that ends inside UpdateAll(), as with the GLUT
+    // front-end, still saves its checkpoint
+    std::cout << "Testing if the last update writes the checkpoint.  ";
+    char last_checkpoint[] = "/tmp/universe-tests-XXXXXX";
+    close(mkstemp(last_checkpoint));
+    unlink(last_checkpoint);
+    std::cout << std::flush;
+    pid_t stepper = fork();
+    assert(stepper >= 0);
+    if(stepper == 0)
+    {
+        char *save_argv[] = { (char *)"tests", (char *)"-q", (char *)"-p", (char *)"50", (char *)"-u", (char *)"3",
+                              (char *)"--save", last_checkpoint, NULL };
+        optind = 1;
+        assert(freopen("/dev/null", "w", stdout) != NULL);
+        Uni::Init(8, save_argv);
+        Uni::RandomPoses();
+        FOR_EACH(r, Uni::population)
+        {
+            r->callback = steer_by_sight;
+            r->callback_data = NULL;
+        }
+        Uni::Start();
+        for(;;)
+        {
+            Uni::UpdateAll(); // exits once the updates run out
+        }
+    }
+    int stepper_status;
+    assert(waitpid(stepper, &stepper_status, 0) == stepper);
+    assert(WIFEXITED(stepper_status) && (WEXITSTATUS(stepper_status) == 0));
+    std::vector<Uni::Robot> saved(50);
+    uint64_t saved_updates = 0;
+    assert(Uni::ReadCheckpointSize(last_checkpoint, restored_count, restored_worldsize) && (restored_count == 50));
+    assert(Uni::LoadCheckpoint(last_checkpoint, restored_bodies, saved, saved_updates));
+    assert(saved_updates == 4);
+    unlink(last_checkpoint);
+    std::cout << "PASSED" << std::endl;
+
+    // testing the sense kernels for fixed pixel counts against the generic
+    // one. Start() leaves threads behind, so this comes after the forks.
+    std::cout << "Testing if fixed-size sensors match the generic one. ";
+    const unsigned int fixed_counts[] = { 8, 16, 32, 64 };
+    std::vector<Uni::Robot::Pixel> specialized;
+    Uni::worldsize = 1;
+    Uni::Robot::range = 0.1;
+    Uni::Robot::fov = Uni::dtor(120.0);
+    Uni::population.resize(1);
+    Uni::Start();
+    for(c = 0; c < 4; ++c)
+    {
+        Uni::Robot::pixel_count = fixed_counts[c];
+        Uni::population.assign(1000, Uni::Robot());
+        for(i = 0; i < Uni::population.size(); ++i)
+        {
+            Uni::RandomPose(Uni::population[i].pose, i);
+        }
+        Uni::BuildIndex();
+
+        Uni::SelectSenseKernel(true);
+        for(i = 0; i < Uni::population.size(); ++i)
+        {
+            Uni::population[i].UpdateSensor();
+        }
+        specialized.assign(Uni::pixel_arena.Data(), Uni::pixel_arena.Data() + (Uni::population.size() * fixed_counts[c]));
+
+        Uni::SelectSenseKernel(false);
+        std::size_t seen_count = 0;
+        for(i = 0; i < Uni::population.size(); ++i)
+        {
+            Uni::population[i].UpdateSensor();
+            FOR_EACH(p, Uni::population[i].pixels)
+            {
+                const Uni::Robot::Pixel &fixed = specialized[(i * fixed_counts[c]) + (p - Uni::population[i].pixels.begin())];
+                assert((p->range == fixed.range) && (p->robot == fixed.robot));
+                seen_count += (p->robot != Uni::Robot::Pixel::NONE) ? 1 : 0;
+            }
+        }
+        assert(seen_count > 0);
+    }
+    Uni::SelectSenseKernel(true);
+    std::cout << "PASSED" << std::endl;
+
     std::cout << std::endl << "All tests passed!" << std::endl;
 
     return 0;
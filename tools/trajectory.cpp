@@ -0,0 +1,162 @@
+// ---------------------------------------------------------------------------
+// trajectory.cpp
+// Prints a trajectory written by universe --trajectory.
+//
+//     trajectory [-s] file
+//     trajectory -c reference file
+//
+// Every pose is printed as "update robot x y a". -s prints one line per
+// frame instead: the update, the number of robots and the mean distance
+// they moved since the frame before, across the torus.
+//
+// -c compares file against a reference run of the same robots, such as
+// the float build against the double build with the same --seed. Each
+// frame prints the update and the mean and largest distance between a
+// robot in the two runs, across the torus. A first line starting with #
+// gives the quantum of the positions compared. Differences below it are
+// lost, and any distance may be off by up to one, so log both runs with
+// --trajectory-exact to compare them in full.
+//
+// This file is available on Github: https://github.com/antsam/universe
+// ---------------------------------------------------------------------------
+#include "src/trajectory.h"
+#include <algorithm>
+#include <unistd.h>
+
+// shortest offset between two coordinates on a torus of side size
+static double wrapped(double d, const double &size)
+{
+    d = fmod(d, size);
+    if(d > (size / 2))
+        d -= size;
+    else if(d < -(size / 2))
+        d += size;
+    return d;
+}
+
+// print how far the robots of file have drifted from reference
+static int compare(const char *reference_path, const char *path)
+{
+    Uni::TrajectoryReader reference, reader;
+    if(!reference.Open(reference_path) || !reader.Open(path))
+    {
+        return -1;
+    }
+
+    if((reference.Robots() != reader.Robots()) || (reference.WorldSize() != reader.WorldSize()))
+    {
+        fprintf(stderr, "[trajectory] %s and %s are not of the same robots\n", reference_path, path);
+        return -1;
+    }
+
+    const double size = reader.WorldSize();
+    const double quantum = std::max(reference.Quantum(), reader.Quantum());
+    std::vector<double> rx, ry, ra, x, y, a;
+    uint64_t reference_update, update, frames = 0;
+    double worst = 0;
+    std::size_t i;
+
+    printf("# quantum %.9f\n", quantum);
+
+    while(reference.Next(reference_update, rx, ry, ra) && reader.Next(update, x, y, a))
+    {
+        if(update != reference_update)
+        {
+            fprintf(stderr, "[trajectory] frames of update %lu and %lu don't line up\n",
+                    (long unsigned)reference_update, (long unsigned)update);
+            return -1;
+        }
+
+        double total = 0, largest = 0, d;
+        for(i = 0; i < x.size(); ++i)
+        {
+            d = hypot(wrapped(x[i] - rx[i], size), wrapped(y[i] - ry[i], size));
+            total += d;
+            largest = std::max(largest, d);
+        }
+
+        printf("%lu %.9f %.9f\n", (long unsigned)update, x.empty() ? 0.0 : (total / x.size()), largest);
+        worst = std::max(worst, largest);
+        ++frames;
+    }
+
+    fprintf(stderr, "[trajectory] %lu frames compared, largest distance %.9f, ", (long unsigned)frames, worst);
+    if(quantum > 0)
+        fprintf(stderr, "positions quantized to %.9f\n", quantum);
+    else
+        fputs("exact positions\n", stderr);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    bool summary = false;
+    const char *reference = NULL;
+    int c;
+
+    while((c = getopt(argc, argv, "sc:")) != -1)
+    {
+        switch(c)
+        {
+            case 's':
+                summary = true;
+                break;
+            case 'c':
+                reference = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-s] file | -c reference file\n", argv[0]);
+                return -1;
+        }
+    }
+
+    if(optind >= argc)
+    {
+        fprintf(stderr, "usage: %s [-s] file | -c reference file\n", argv[0]);
+        return -1;
+    }
+
+    if(reference != NULL)
+    {
+        return compare(reference, argv[optind]);
+    }
+
+    Uni::TrajectoryReader reader;
+    if(!reader.Open(argv[optind]))
+    {
+        return -1;
+    }
+
+    const double size = reader.WorldSize();
+    std::vector<double> x, y, a, last_x, last_y;
+    uint64_t update, frames = 0;
+    std::size_t i;
+
+    while(reader.Next(update, x, y, a))
+    {
+        if(!summary)
+        {
+            for(i = 0; i < x.size(); ++i)
+            {
+                printf("%lu %lu %.6f %.6f %.5f\n", (long unsigned)update, (long unsigned)i, x[i], y[i], a[i]);
+            }
+        }
+        else
+        {
+            double moved = 0;
+            for(i = 0; (frames > 0) && (i < x.size()); ++i)
+            {
+                moved += hypot(wrapped(x[i] - last_x[i], size), wrapped(y[i] - last_y[i], size));
+            }
+
+            printf("%lu %lu %.6f\n", (long unsigned)update, (long unsigned)x.size(),
+                   x.empty() ? 0.0 : (moved / x.size()));
+            last_x.swap(x);
+            last_y.swap(y);
+        }
+        ++frames;
+    }
+
+    fprintf(stderr, "[trajectory] %lu frames of %lu robots\n", (long unsigned)frames, (long unsigned)reader.Robots());
+    return 0;
+}